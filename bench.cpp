@@ -0,0 +1,523 @@
+// dynamicsystems-bench: reproducible benchmarks of the compute, colorize and
+// encode stages, written as JSON to track regressions between builds
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "compute.hpp"
+#include "picture.hpp"
+#include "render.hpp"
+#include "textexport.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+const char* sin_name(SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return "low";
+    case SinAccuracy::medium:
+      return "medium";
+    case SinAccuracy::high:
+      return "high";
+    default:
+      return "exact";
+  }
+}
+
+// floating point operations of one sin2pi: 9 for the argument reduction and
+// the sign plus 2 per polynomial coefficient, std::sin is counted as 20
+int sin_flops(SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return 15;
+    case SinAccuracy::medium:
+      return 17;
+    case SinAccuracy::high:
+      return 19;
+    default:
+      return 20;
+  }
+}
+
+// one seed iteration: two sines, two multiply-adds and the |y| maximum
+int flops_per_seed_iteration(SinAccuracy accuracy) {
+  return 2 * sin_flops(accuracy) + 6;
+}
+
+// median of the wall times of repetitions runs of work, each run repeats
+// work until it took at least min_seconds and is divided by the count
+double median_seconds(const std::function<void()>& work, int repetitions,
+                      double min_seconds) {
+  std::vector<double> times;
+  for (int r = 0; r < repetitions; r++) {
+    long count = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+      work();
+      count++;
+      elapsed = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    } while (elapsed < min_seconds);
+    times.push_back(elapsed / count);
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+// JSON object written field by field, numbers in the classic locale
+class JsonObject {
+ public:
+  explicit JsonObject(std::ostream& out, int indent)
+      : out_(out), indent_(indent) {
+    out_ << "{";
+  }
+
+  void field(const std::string& name, const std::string& value) {
+    key(name);
+    out_ << '"' << value << '"';
+  }
+  void field(const std::string& name, const char* value) {
+    field(name, std::string(value));
+  }
+  void field(const std::string& name, double value) {
+    key(name);
+    out_ << value;
+  }
+  void field(const std::string& name, long long value) {
+    key(name);
+    out_ << value;
+  }
+  void field(const std::string& name, int value) {
+    field(name, static_cast<long long>(value));
+  }
+  void field(const std::string& name, bool value) {
+    key(name);
+    out_ << (value ? "true" : "false");
+  }
+
+  // starts an array of objects, each begun with element()
+  void array(const std::string& name) {
+    key(name);
+    out_ << "[";
+    first_element_ = true;
+  }
+  JsonObject element() {
+    if (!first_element_) out_ << ",";
+    first_element_ = false;
+    out_ << "\n" << std::string(indent_ + 4, ' ');
+    return JsonObject(out_, indent_ + 4);
+  }
+  void end_array() { out_ << "\n" << std::string(indent_ + 2, ' ') << "]"; }
+
+  JsonObject object(const std::string& name) {
+    key(name);
+    return JsonObject(out_, indent_ + 2);
+  }
+
+  void end() { out_ << "\n" << std::string(indent_, ' ') << "}"; }
+
+ private:
+  void key(const std::string& name) {
+    if (!first_field_) out_ << ",";
+    first_field_ = false;
+    out_ << "\n" << std::string(indent_ + 2, ' ') << '"' << name << "\": ";
+  }
+
+  std::ostream& out_;
+  int indent_;
+  bool first_field_ = true;
+  bool first_element_ = true;
+};
+
+// iterations compute() runs for the pixel, the escape iteration if it
+// escapes within num_iterations
+int iterations_done(float alpha, float beta, const aligned_vector<float>& seed_x,
+                    const aligned_vector<float>& seed_y, int num_iterations,
+                    float threshold, Scratch& scratch,
+                    SinAccuracy accuracy) {
+  if (compute(alpha, beta, seed_x, seed_y, num_iterations, threshold, scratch,
+              accuracy) <= threshold) {
+    return num_iterations;
+  }
+  // smallest n after which the pixel has escaped
+  int low = 1, high = num_iterations;
+  while (low < high) {
+    int mid = low + (high - low) / 2;
+    if (compute(alpha, beta, seed_x, seed_y, mid, threshold, scratch,
+                accuracy) > threshold) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+struct Settings {
+  int repetitions = 5;
+  double min_seconds = 0.05;
+  bool quick = false;
+  std::string directory;
+};
+
+void bench_compute(JsonObject& json, const Settings& settings) {
+  struct Regime {
+    const char* name;
+    float alpha;
+    float beta;
+  };
+  // small parameters stay bounded, large ones escape after a few iterations
+  const Regime regimes[] = {{"bounded", 0.05f, 0.05f},
+                            {"escaped", 0.9f, 0.9f}};
+  std::vector<int> seed_counts = {1, 8, 16, 64};
+  std::vector<int> iteration_counts = {100, 1000};
+  if (settings.quick) seed_counts = {8, 16};
+
+  const float threshold = 1.0f;
+  Scratch scratch;
+  json.array("compute");
+  for (const Regime& regime : regimes) {
+    for (SinAccuracy accuracy : {SinAccuracy::exact, SinAccuracy::low}) {
+      for (int num_seeds : seed_counts) {
+        for (int num_iterations : iteration_counts) {
+          aligned_vector<float> seed_x, seed_y;
+          make_seed_points(num_seeds, {}, seed_x, seed_y);
+          int iterations =
+              iterations_done(regime.alpha, regime.beta, seed_x, seed_y,
+                              num_iterations, threshold, scratch, accuracy);
+          double seconds = median_seconds(
+              [&] {
+                compute(regime.alpha, regime.beta, seed_x, seed_y,
+                        num_iterations, threshold, scratch, accuracy);
+              },
+              settings.repetitions, settings.min_seconds);
+          double seed_iterations = double(iterations) * num_seeds;
+          JsonObject entry = json.element();
+          entry.field("regime", regime.name);
+          entry.field("sin", sin_name(accuracy));
+          entry.field("seeds", num_seeds);
+          entry.field("max_iterations", num_iterations);
+          entry.field("iterations", iterations);
+          entry.field("ns_per_pixel", seconds * 1e9);
+          entry.field("ns_per_pixel_iteration", seconds * 1e9 / iterations);
+          entry.field("ns_per_seed_iteration",
+                      seconds * 1e9 / seed_iterations);
+          entry.field("gflops", seed_iterations *
+                                    flops_per_seed_iteration(accuracy) /
+                                    seconds * 1e-9);
+          entry.end();
+        }
+      }
+    }
+  }
+  json.end_array();
+}
+
+void bench_grid(JsonObject& json, const Settings& settings) {
+  std::vector<int> sizes = {256, 1024};
+  if (settings.quick) sizes = {256};
+  const int num_iterations = 200;
+  const float threshold = 1.0f;
+  aligned_vector<float> seed_x, seed_y;
+  make_seed_points(8, {}, seed_x, seed_y);
+
+  json.array("compute_grid");
+  for (int size : sizes) {
+    for (SinAccuracy accuracy : {SinAccuracy::exact, SinAccuracy::low}) {
+      aligned_vector<float> alphas = parameter_values(0, 1, size - 1);
+      aligned_vector<float> betas = parameter_values(0, 1, size - 1);
+      aligned_vector<float> result(std::size_t(size) * size);
+      ComputeOptions options;
+      options.sin_accuracy = accuracy;
+      double seconds = median_seconds(
+          [&] {
+            compute_grid(result.data(), alphas, betas, seed_x, seed_y,
+                         num_iterations, threshold, options);
+          },
+          settings.quick ? 1 : 3, 0);
+      JsonObject entry = json.element();
+      entry.field("width", size);
+      entry.field("height", size);
+      entry.field("iterations", num_iterations);
+      entry.field("sin", sin_name(accuracy));
+      entry.field("seconds", seconds);
+      entry.field("mpixels_per_second", double(size) * size / seconds * 1e-6);
+      entry.end();
+    }
+  }
+  json.end_array();
+
+  // end to end, including the PNG and raw outputs, written to the directory
+  json.array("compute_all");
+  for (int size : sizes) {
+    ComputeOptions options;
+    options.raw_output = "result.raw";
+    std::streambuf* cout_buffer = std::cout.rdbuf();
+    std::ostringstream silenced;
+    std::cout.rdbuf(silenced.rdbuf());
+    double seconds = median_seconds(
+        [&] {
+          compute_all(num_iterations, threshold, 0, 1, size - 1, 0, 1,
+                      size - 1, 8, false, std::vector<float>(), options);
+        },
+        1, 0);
+    std::cout.rdbuf(cout_buffer);
+    JsonObject entry = json.element();
+    entry.field("width", size);
+    entry.field("height", size);
+    entry.field("iterations", num_iterations);
+    entry.field("seconds", seconds);
+    entry.field("mpixels_per_second", double(size) * size / seconds * 1e-6);
+    entry.end();
+  }
+  json.end_array();
+}
+
+// fixed cost of a render for small previews: a fresh RenderEngine per render
+// starts its threads and allocates its scratches every time, a reused one
+// only computes
+void bench_render(JsonObject& json, const Settings& settings) {
+  std::vector<int> sizes = {2, 16, 64, 256};
+  if (settings.quick) sizes = {2, 64};
+  std::vector<int> thread_counts = {1, std::max(4, default_num_threads())};
+  const int num_iterations = 50;
+
+  json.array("render");
+  for (int threads : thread_counts) {
+    for (int size : sizes) {
+      ParameterGrid grid;
+      grid.num_iterations = num_iterations;
+      grid.threshold = 1.0f;
+      grid.alphamax = 1.0f;
+      grid.betamax = 1.0f;
+      grid.alpha_num_intervals = size - 1;
+      grid.beta_num_intervals = size - 1;
+      ComputeOptions options;
+      options.num_threads = threads;
+      options.tile_size = 16;
+      options.png_output.clear();
+
+      double fresh_seconds = median_seconds(
+          [&] {
+            RenderEngine engine(options);
+            engine.render(grid);
+          },
+          settings.repetitions, settings.min_seconds);
+      RenderEngine engine(options);
+      engine.render(grid);
+      double reused_seconds = median_seconds(
+          [&] { engine.render(grid); }, settings.repetitions,
+          settings.min_seconds);
+      JsonObject entry = json.element();
+      entry.field("width", size);
+      entry.field("height", size);
+      entry.field("iterations", num_iterations);
+      entry.field("threads", threads);
+      entry.field("fresh_engine_us", fresh_seconds * 1e6);
+      entry.field("reused_engine_us", reused_seconds * 1e6);
+      entry.field("saved_us", (fresh_seconds - reused_seconds) * 1e6);
+      entry.end();
+    }
+  }
+  json.end_array();
+}
+
+void bench_outputs(JsonObject& json, const Settings& settings) {
+  // a real result to encode, computed once
+  const int size = settings.quick ? 512 : 2048;
+  const float threshold = 1.0f;
+  aligned_vector<float> seed_x, seed_y;
+  make_seed_points(8, {}, seed_x, seed_y);
+  aligned_vector<float> alphas = parameter_values(0, 1, size - 1);
+  aligned_vector<float> betas = parameter_values(0, 1, size - 1);
+  aligned_vector<float> result(std::size_t(size) * size);
+  ComputeOptions compute_options;
+  compute_options.sin_accuracy = SinAccuracy::low;
+  compute_grid(result.data(), alphas, betas, seed_x, seed_y, 100, threshold,
+               compute_options);
+
+  // colorize a 48M pixel frame made of copies of the result
+  const std::size_t frame_pixels = settings.quick ? 4000000 : 48000000;
+  std::vector<float> frame(frame_pixels);
+  for (std::size_t i = 0; i < frame_pixels; i += result.size()) {
+    std::copy_n(result.begin(), std::min(result.size(), frame_pixels - i),
+                frame.begin() + i);
+  }
+  std::vector<unsigned char> rgb(3 * frame_pixels);
+  double seconds = median_seconds(
+      [&] {
+        colorize(frame.data(), frame_pixels, threshold, Colormap::viridis,
+                 rgb.data());
+      },
+      settings.repetitions, 0);
+  JsonObject colorize_json = json.object("colorize");
+  colorize_json.field("pixels", static_cast<long long>(frame_pixels));
+  colorize_json.field("seconds", seconds);
+  colorize_json.field("mpixels_per_second", frame_pixels / seconds * 1e-6);
+  colorize_json.end();
+  frame = std::vector<float>();
+  rgb = std::vector<unsigned char>();
+
+  json.array("write_png");
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  std::string png_file = settings.directory + "/bench.png";
+  std::vector<int> thread_counts = {1};
+  if (max_threads > 1) thread_counts.push_back(max_threads);
+  for (int level : {1, 6}) {
+    for (int threads : thread_counts) {
+      PngOptions options;
+      options.compression_level = level;
+      options.num_threads = threads;
+      seconds = median_seconds(
+          [&] {
+            write_png(png_file.c_str(), result.data(), threshold, size, size,
+                      options);
+          },
+          settings.quick ? 1 : 3, 0);
+      JsonObject entry = json.element();
+      entry.field("width", size);
+      entry.field("height", size);
+      entry.field("level", level);
+      entry.field("threads", threads);
+      entry.field("seconds", seconds);
+      entry.field("bytes",
+                  static_cast<long long>(std::filesystem::file_size(png_file)));
+      entry.field("mpixels_per_second", double(size) * size / seconds * 1e-6);
+      entry.end();
+    }
+  }
+  json.end_array();
+  std::filesystem::remove(png_file);
+
+  std::string csv_file = settings.directory + "/bench.csv";
+  std::size_t bytes = 0;
+  seconds = median_seconds(
+      [&] {
+        bytes = write_csv(csv_file, result.data(), alphas.data(), size,
+                          betas.data(), size);
+      },
+      settings.quick ? 1 : 3, 0);
+  std::filesystem::remove(csv_file);
+  JsonObject csv_json = json.object("csv");
+  csv_json.field("pixels", static_cast<long long>(result.size()));
+  csv_json.field("bytes", static_cast<long long>(bytes));
+  csv_json.field("seconds", seconds);
+  csv_json.field("mb_per_second", bytes / seconds * 1e-6);
+  csv_json.end();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Settings settings;
+  std::string output;
+
+  namespace po = boost::program_options;
+  try {
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help", "Help message")
+      ("output,o", po::value<std::string>(&output),
+      " JSON file to write, standard output if not given")
+      ("quick", po::bool_switch(&settings.quick),
+      " Smaller sizes and fewer variants, for a quick check")
+      ("repetitions,r", po::value<int>(&settings.repetitions)
+      ->default_value(5),
+      " Runs per measurement, the median is reported")
+      ("directory,d", po::value<std::string>(&settings.directory),
+      " Directory for the files written by the benchmarks, a temporary one"
+      " if not given")
+      ;
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      return 0;
+    }
+    po::notify(vm);
+    if (settings.repetitions < 1) {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "repetitions");
+    }
+  } catch (po::error& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  try {
+    namespace fs = std::filesystem;
+    fs::path directory = settings.directory.empty()
+                             ? fs::temp_directory_path() / "dynamicsystems-bench"
+                             : fs::path(settings.directory);
+    fs::create_directories(directory);
+    settings.directory = fs::absolute(directory).string();
+
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    JsonObject json(out, 0);
+
+    JsonObject build = json.object("build");
+#ifdef __VERSION__
+    build.field("compiler", __VERSION__);
+#endif
+#ifdef _OPENMP
+    build.field("openmp", true);
+    build.field("threads", omp_get_max_threads());
+#else
+    build.field("openmp", false);
+    build.field("threads", default_num_threads());
+#endif
+#ifdef NDEBUG
+    build.field("assertions", false);
+#else
+    build.field("assertions", true);
+#endif
+    build.field("quick", settings.quick);
+    build.field("repetitions", settings.repetitions);
+    build.end();
+
+    bench_compute(json, settings);
+    // compute_all writes its files to the working directory
+    fs::path working_directory = fs::current_path();
+    fs::current_path(directory);
+    bench_grid(json, settings);
+    fs::current_path(working_directory);
+    bench_render(json, settings);
+    bench_outputs(json, settings);
+    json.end();
+    out << "\n";
+
+    if (output.empty()) {
+      std::cout << out.str();
+    } else {
+      std::ofstream file(output);
+      if (!(file << out.str())) {
+        throw std::runtime_error("error writing " + output);
+      }
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+}
@@ -0,0 +1,163 @@
+#include "checkpoint.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+const char MAGIC[8] = {'D', 'S', 'C', 'H', 'K', 'P', 'T', '1'};
+
+template <typename T>
+void write_value(std::ostream& stream, const T& value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read_value(std::istream& stream, T& value) {
+  return static_cast<bool>(
+      stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+}  // namespace
+
+Checkpoint::Checkpoint(const std::string& filename,
+                       const std::string& parameters, int width, int height,
+                       float* result, bool resume, double interval_seconds)
+    : filename_(filename),
+      width_(width),
+      height_(height),
+      result_(result),
+      interval_seconds_(interval_seconds),
+      last_flush_(std::chrono::steady_clock::now()) {
+  if (resume) read(parameters);
+
+  // (re)write the file, this drops a partially written last record
+  std::string temporary = filename_ + ".tmp";
+  file_.open(temporary, std::ios::binary | std::ios::trunc);
+  if (!file_) throw std::runtime_error("error opening file " + temporary);
+  file_.write(MAGIC, sizeof(MAGIC));
+  write_value<std::uint64_t>(file_, parameters.size());
+  file_.write(parameters.data(), parameters.size());
+  write_value<std::int32_t>(file_, width_);
+  write_value<std::int32_t>(file_, height_);
+  for (const Tile& tile : restored_) write_tile(tile);
+  file_.close();
+
+#ifdef _WIN32
+  // rename does not replace an existing file on Windows
+  std::remove(filename_.c_str());
+#endif
+  if (std::rename(temporary.c_str(), filename_.c_str()) != 0) {
+    throw std::runtime_error("error renaming " + temporary + " to " +
+                             filename_);
+  }
+  file_.open(filename_, std::ios::binary | std::ios::app);
+  if (!file_) throw std::runtime_error("error opening file " + filename_);
+}
+
+Checkpoint::~Checkpoint() { file_.flush(); }
+
+void Checkpoint::read(const std::string& parameters) {
+  std::ifstream file(filename_, std::ios::binary);
+  if (!file) {
+    std::cout << "no checkpoint " << filename_ << " found, starting anew"
+              << std::endl;
+    return;
+  }
+
+  std::string file_parameters;
+  int width, height;
+  read_checkpoint_header(file, filename_, file_parameters, width, height);
+  if (file_parameters != parameters || width != width_ || height != height_) {
+    throw std::runtime_error("checkpoint " + filename_ +
+                             " was written with different parameters:\n" +
+                             file_parameters);
+  }
+
+  for (const Tile& tile :
+       read_checkpoint_tiles(file, filename_, width_, height_, result_)) {
+    if (restored_keys_.insert(key(tile)).second) restored_.push_back(tile);
+  }
+  std::cout << "resuming from " << filename_ << " with " << restored_.size()
+            << " finished tiles" << std::endl;
+}
+
+bool Checkpoint::finished(const Tile& tile) const {
+  return restored_keys_.count(key(tile)) > 0;
+}
+
+void Checkpoint::write_tile(const Tile& tile) {
+  std::int32_t header[4] = {tile.x0, tile.y0, tile.width, tile.height};
+  file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+  for (int r = tile.y0; r < tile.y0 + tile.height; r++) {
+    file_.write(reinterpret_cast<const char*>(
+                    result_ + static_cast<std::size_t>(r) * width_ + tile.x0),
+                tile.width * sizeof(float));
+  }
+}
+
+void Checkpoint::save(const Tile& tile) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  write_tile(tile);
+  auto now = std::chrono::steady_clock::now();
+  if (std::chrono::duration<double>(now - last_flush_).count() >=
+      interval_seconds_) {
+    file_.flush();
+    last_flush_ = now;
+  }
+  // called from the workers, so a failing checkpoint does not abort the run
+  if (!file_ && !failed_) {
+    std::cerr << "error writing checkpoint " << filename_ << std::endl;
+    failed_ = true;
+  }
+}
+
+void read_checkpoint_header(std::istream& file, const std::string& filename,
+                            std::string& parameters, int& width, int& height) {
+  char magic[sizeof(MAGIC)];
+  std::uint64_t parameters_size;
+  if (!file.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+      !read_value(file, parameters_size)) {
+    throw std::runtime_error(filename + " is not a checkpoint file");
+  }
+  parameters.assign(parameters_size, '\0');
+  std::int32_t file_width, file_height;
+  if (!file.read(&parameters[0], parameters_size) ||
+      !read_value(file, file_width) || !read_value(file, file_height)) {
+    throw std::runtime_error(filename + " is not a checkpoint file");
+  }
+  width = file_width;
+  height = file_height;
+}
+
+std::vector<Tile> read_checkpoint_tiles(std::istream& file,
+                                        const std::string& filename,
+                                        int width, int height, float* result) {
+  std::vector<Tile> tiles;
+  std::vector<float> pixels;
+  std::int32_t header[4];
+  while (file.read(reinterpret_cast<char*>(header), sizeof(header))) {
+    Tile tile = {header[0], header[1], header[2], header[3]};
+    if (tile.x0 < 0 || tile.y0 < 0 || tile.width < 1 || tile.height < 1 ||
+        tile.x0 + tile.width > width || tile.y0 + tile.height > height) {
+      throw std::runtime_error("corrupt tile record in " + filename);
+    }
+    pixels.resize(static_cast<std::size_t>(tile.width) * tile.height);
+    if (!file.read(reinterpret_cast<char*>(pixels.data()),
+                   pixels.size() * sizeof(float))) {
+      break;
+    }
+    for (int r = 0; r < tile.height; r++) {
+      std::copy(pixels.begin() + r * tile.width,
+                pixels.begin() + (r + 1) * tile.width,
+                result + static_cast<std::size_t>(tile.y0 + r) * width +
+                    tile.x0);
+    }
+    tiles.push_back(tile);
+  }
+  return tiles;
+}
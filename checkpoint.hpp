@@ -0,0 +1,70 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "scheduler.hpp"
+
+// On disk record of the finished tiles of a grid computation. The file
+// starts with the parameter description of the run, followed by one record
+// per finished tile: its position and size and its pixels. A run with the
+// same parameters can resume from it and only compute the missing tiles.
+class Checkpoint {
+ public:
+  // Starts a new checkpoint file. With resume an existing file is read
+  // first and its tiles are restored into result (width x height pixels);
+  // a file written for other parameters is refused with std::runtime_error.
+  // Tiles are flushed to disk at most every interval_seconds.
+  Checkpoint(const std::string& filename, const std::string& parameters,
+             int width, int height, float* result, bool resume,
+             double interval_seconds);
+  ~Checkpoint();
+
+  // true if the tile was restored from the checkpoint file
+  bool finished(const Tile& tile) const;
+  std::size_t num_restored() const { return restored_.size(); }
+
+  // appends the pixels of a finished tile, can be called from any thread
+  void save(const Tile& tile);
+
+ private:
+  typedef std::tuple<int, int, int, int> TileKey;
+  static TileKey key(const Tile& tile) {
+    return TileKey(tile.x0, tile.y0, tile.width, tile.height);
+  }
+
+  void read(const std::string& parameters);
+  void write_tile(const Tile& tile);
+
+  std::string filename_;
+  int width_;
+  int height_;
+  float* result_;
+  std::vector<Tile> restored_;
+  std::set<TileKey> restored_keys_;
+
+  std::mutex mutex_;
+  std::ofstream file_;
+  double interval_seconds_;
+  std::chrono::steady_clock::time_point last_flush_;
+  bool failed_ = false;
+};
+
+// reads the header of a checkpoint file opened in binary mode, throws
+// std::runtime_error if it is not a checkpoint file
+void read_checkpoint_header(std::istream& file, const std::string& filename,
+                            std::string& parameters, int& width, int& height);
+
+// reads the tile records following the header into result (width x height
+// pixels) until the end of the file, a truncated last record is ignored
+std::vector<Tile> read_checkpoint_tiles(std::istream& file,
+                                        const std::string& filename,
+                                        int width, int height, float* result);
+
+#endif  // CHECKPOINT_H
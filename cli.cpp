@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include <boost/program_options.hpp>
 
 #include "compute.hpp"
+#include "instrumentation.hpp"
+#include "scaling.hpp"
 
 int main(int argc, char* argv[]) {
   // get arguments from CLI
@@ -18,7 +24,26 @@ int main(int argc, char* argv[]) {
   int beta_num_intervals;
   int num_seedpoints;
   bool output_csv;
+  bool output_raw;
+  bool tsv;
+  bool output_png;
+  bool output_gray16;
+  bool output_pfm;
   std::vector<float> seedpoints;
+  std::string kernel;
+  std::string sin_accuracy;
+  std::string schedule;
+  std::string png_filter;
+  std::string colormap;
+  bool periodicity_exact;
+  std::string shard;
+  std::string scaling;
+  std::vector<int> scaling_sizes;
+  int scaling_repetitions;
+  double cache_size;
+  bool no_cache;
+  std::string recolor;
+  ComputeOptions options;
 
   namespace po = boost::program_options;
   try {
@@ -47,6 +72,130 @@ int main(int argc, char* argv[]) {
       " Values for explicit seedpoints")
       ("csv,O", po::value<bool>(&output_csv)->default_value(false),
       " Boolean flag for output a csv file")
+      ("raw,R", po::value<bool>(&output_raw)->default_value(true),
+      " Boolean flag for output of the binary result file result.raw")
+      ("png", po::value<bool>(&output_png)->default_value(true),
+      " Boolean flag for output of the colored picture.png")
+      ("gray16", po::bool_switch(&output_gray16),
+      " Write the result as 16bit grayscale picture16.png")
+      ("pfm", po::bool_switch(&output_pfm),
+      " Write the float values as portable float map result.pfm")
+      ("tsv", po::bool_switch(&tsv),
+      " Write the text output tab separated to result.tsv")
+      ("precision", po::value<int>(&options.text_format.precision)
+      ->default_value(0),
+      " Significant digits of the text output, 0 for shortest exact")
+      ("colormap", po::value<std::string>(&colormap)
+      ->default_value("viridis"),
+      " Colors of picture.png: 'magma', 'inferno', 'plasma' or 'viridis'")
+      ("clip-min", po::value<float>(&options.png.clip_min)->default_value(0),
+      " Value taking the first color of the colormap, lower values as well")
+      ("clip-max", po::value<float>(&options.png.clip_max)->default_value(0),
+      " Value taking the last color of the colormap, higher values up to the"
+      " threshold as well, 0 for the threshold")
+      ("gamma", po::value<float>(&options.png.gamma)->default_value(1),
+      " Gamma of the colors, values above 1 spread the low values over more"
+      " colors")
+      ("invert", po::bool_switch(&options.png.invert),
+      " Reverse the colormap")
+      ("png-level",
+      po::value<int>(&options.png.compression_level)->default_value(6),
+      " zlib compression level of picture.png, 0 (fast, large) to 9 (slow,"
+      " small)")
+      ("png-filter", po::value<std::string>(&png_filter)
+      ->default_value("adaptive"),
+      " PNG row filter: 'none', 'sub', 'up', 'average', 'paeth' or"
+      " 'adaptive'")
+      ("png-threads", po::value<int>(&options.png.num_threads)
+      ->default_value(0),
+      " Threads compressing stripes of picture.png, 1 for plain libpng, 0"
+      " for the default")
+      ("kernel", po::value<std::string>(&kernel)->default_value("seeds"),
+      " Compute kernel: 'seeds' (SIMD over seedpoints), 'pixels' (SIMD over"
+      " neighbouring pixels, only faster with --sin low, medium or high) or"
+      " 'fixed' (fixed point phases, table sine)")
+      ("sin", po::value<std::string>(&sin_accuracy)->default_value("exact"),
+      " Accuracy of sin(2 pi x): 'exact' (std::sin), 'low' (7e-5), 'medium'"
+      " (8e-7) or 'high' (2e-7)")
+      ("schedule", po::value<std::string>(&schedule)->default_value("tiles"),
+      " Work distribution: 'tiles' (work stealing over square tiles) or"
+      " 'rows' (OpenMP dynamic schedule over rows)")
+      ("tile-size", po::value<int>(&options.tile_size)->default_value(64),
+      " Edge length of the tiles in pixels")
+      ("threads", po::value<int>(&options.num_threads)->default_value(0),
+      " Number of threads of the tile schedule, 0 for the default")
+      ("adaptive", po::bool_switch(&options.adaptive),
+      " Fill the interior of tile blocks with uniform border instead of"
+      " computing it (Mariani-Silver), by default only escaped blocks")
+      ("adaptive-tolerance",
+      po::value<float>(&options.adaptive_tolerance)->default_value(-1.0f,
+      "off"),
+      " Also fill bounded blocks whose border values differ by at most"
+      " this, their values are interpolated (approximate)")
+      ("adaptive-verify", po::bool_switch(&options.adaptive_verify),
+      " Compare the adaptive result and time with a full computation")
+      ("periodicity", po::bool_switch(&options.periodicity),
+      " Retire pixels early once all seed orbits are periodic (seeds kernel)")
+      ("periodicity-epsilon",
+      po::value<float>(&options.periodicity_epsilon)->default_value(1e-6f),
+      " Tolerance of the orbit state comparison")
+      ("periodicity-exact", po::bool_switch(&periodicity_exact),
+      " Only accept exactly repeating orbit states (epsilon 0)")
+      ("checkpoint", po::value<std::string>(&options.checkpoint),
+      " File to record finished tiles in")
+      ("checkpoint-interval",
+      po::value<double>(&options.checkpoint_interval)->default_value(60),
+      " Seconds between flushes of the checkpoint file")
+      ("resume", po::bool_switch(&options.resume),
+      " Continue the computation recorded in the checkpoint file")
+      ("save-state", po::value<std::string>(&options.save_state),
+      " File to save the orbit states of the bounded pixels to")
+      ("deepen", po::value<std::string>(&options.deepen),
+      " Continue the bounded pixels of a --save-state file of a run with"
+      " fewer iterations")
+      ("shard", po::value<std::string>(&shard),
+      " Compute only shard i/N of the tiles, merge the shards with"
+      " dynamicsystems-merge")
+      ("out-of-core", po::bool_switch(&options.out_of_core),
+      " Compute into the memory mapped result.raw instead of memory, for"
+      " grids larger than the memory")
+      ("stream", po::bool_switch(&options.stream),
+      " Write the images row by row while computing, without keeping the"
+      " result (no other output)")
+      ("stream-window",
+      po::value<int>(&options.stream_window)->default_value(0),
+      " Rows computed ahead of the written ones with --stream, 0 for four"
+      " per thread")
+      ("scaling", po::value<std::string>(&scaling),
+      " Instead of the outputs, measure the thread scaling of the grid and"
+      " write it to <prefix>.csv and <prefix>.json")
+      ("scaling-sizes", po::value<std::vector<int>>(&scaling_sizes)
+      ->multitoken(),
+      " Grid widths of the scaling study (default: the width), heights keep"
+      " the aspect ratio")
+      ("scaling-repetitions",
+      po::value<int>(&scaling_repetitions)->default_value(3),
+      " Runs per point of the scaling study, the median is reported")
+      ("cache-dir", po::value<std::string>(&options.cache_dir),
+      " Directory to reuse the results of runs with the same parameters"
+      " from, default: $DYNAMICSYSTEMS_CACHE_DIR")
+      ("cache-size", po::value<double>(&cache_size)->default_value(4096),
+      " Size limit of the cache directory in MB, the least recently used"
+      " results are removed beyond it")
+      ("no-cache", po::bool_switch(&no_cache),
+      " Compute even if the result is cached, and do not cache it")
+      ("report", po::value<std::string>(&options.report),
+      " Write iterations, tile timings and the escape histogram to a JSON"
+      " file (instrumented builds only)")
+      ("cost-map", po::value<std::string>(&options.cost_map),
+      " Write the iterations per pixel as a PNG heatmap (instrumented builds"
+      " only)")
+      ("recolor", po::value<std::string>(&recolor),
+      " Instead of computing, write the images and --csv output of a result"
+      " file saved before, e.g. with other --colormap, --clip-min,"
+      " --clip-max, --gamma or --invert")
+      ("compare", po::bool_switch(&options.compare),
+      " Compare the result with the float kernel using std::sin")
       ;
       
 
@@ -66,23 +215,250 @@ int main(int argc, char* argv[]) {
       throw po::validation_error(po::validation_error::invalid_option_value);
     }
 
+    if (kernel == "seeds") {
+      options.kernel = Kernel::seeds;
+    } else if (kernel == "pixels") {
+      options.kernel = Kernel::pixels;
+    } else if (kernel == "fixed") {
+      options.kernel = Kernel::fixed;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "kernel", kernel);
+    }
+
+    if (schedule == "tiles") {
+      options.schedule = Schedule::tiles;
+    } else if (schedule == "rows") {
+      options.schedule = Schedule::rows;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "schedule", schedule);
+    }
+
+    if (options.stream) {
+      if (output_csv || !vm["raw"].defaulted() ||
+          !options.checkpoint.empty() || !options.save_state.empty() ||
+          !options.deepen.empty() || !shard.empty() || options.adaptive ||
+          options.compare || options.adaptive_verify) {
+        throw po::error("--stream writes only the images and can not be"
+                        " combined with other outputs, --checkpoint,"
+                        " --save-state, --deepen, --shard, --adaptive or"
+                        " --compare");
+      }
+      output_raw = false;
+    }
+    if (options.out_of_core) {
+      if (!output_raw || options.stream || !shard.empty() ||
+          !options.checkpoint.empty() ||
+          !options.save_state.empty() || !options.deepen.empty() ||
+          options.compare || options.adaptive_verify) {
+        throw po::error("--out-of-core requires --raw and can not be combined"
+                        " with --stream, --shard, --checkpoint, --save-state,"
+                        " --deepen or --compare");
+      }
+    }
+    // the scaling study times compute_grid on the whole grid and writes
+    // only its own files
+    if (!scaling.empty()) {
+      for (const char* name :
+           {"csv", "raw", "png", "gray16", "pfm", "tsv", "adaptive",
+            "adaptive-tolerance", "adaptive-verify", "checkpoint", "resume",
+            "save-state", "deepen", "shard", "out-of-core", "stream",
+            "report", "cost-map", "recolor", "compare"}) {
+        if (!vm[name].empty() && !vm[name].defaulted()) {
+          throw po::error(std::string("--scaling can not be combined with --") +
+                          name);
+        }
+      }
+    }
+    if (!options.report.empty() || !options.cost_map.empty()) {
+      if (!instrumentation_enabled) {
+        throw po::error("--report and --cost-map need a build with"
+                        " -DDYNAMICSYSTEMS_INSTRUMENTATION=ON");
+      }
+      if (options.stream || options.out_of_core || !options.deepen.empty()) {
+        throw po::error("--report and --cost-map can not be combined with"
+                        " --stream, --out-of-core or --deepen");
+      }
+    }
+    if (options.stream_window < 0) {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "stream-window");
+    }
+
+    if (colormap == "magma") {
+      options.png.colormap = Colormap::magma;
+    } else if (colormap == "inferno") {
+      options.png.colormap = Colormap::inferno;
+    } else if (colormap == "plasma") {
+      options.png.colormap = Colormap::plasma;
+    } else if (colormap == "viridis") {
+      options.png.colormap = Colormap::viridis;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "colormap", colormap);
+    }
+
+    if (png_filter == "none") {
+      options.png.filter = PngFilter::none;
+    } else if (png_filter == "sub") {
+      options.png.filter = PngFilter::sub;
+    } else if (png_filter == "up") {
+      options.png.filter = PngFilter::up;
+    } else if (png_filter == "average") {
+      options.png.filter = PngFilter::average;
+    } else if (png_filter == "paeth") {
+      options.png.filter = PngFilter::paeth;
+    } else if (png_filter == "adaptive") {
+      options.png.filter = PngFilter::adaptive;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "png-filter", png_filter);
+    }
+    if (!(options.png.gamma > 0) ||
+        (options.png.clip_max != 0 &&
+         !(options.png.clip_max > options.png.clip_min)) ||
+        (options.png.clip_max == 0 && recolor.empty() &&
+         !(threshold > options.png.clip_min))) {
+      throw po::error("--gamma must be positive and --clip-max (or the"
+                      " threshold) larger than --clip-min");
+    }
+    if (options.png.compression_level < 0 ||
+        options.png.compression_level > 9 || options.png.num_threads < 0) {
+      throw po::validation_error(po::validation_error::invalid_option_value);
+    }
+
+    if (output_raw) options.raw_output = "result.raw";
+    if (options.cache_dir.empty()) {
+      const char* cache_dir = std::getenv("DYNAMICSYSTEMS_CACHE_DIR");
+      if (cache_dir) options.cache_dir = cache_dir;
+    }
+    if (no_cache) options.cache_dir.clear();
+    if (cache_size < 0) {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "cache-size");
+    }
+    options.cache_max_bytes =
+        static_cast<std::uint64_t>(cache_size * (1 << 20));
+    if (!output_png) options.png_output.clear();
+    if (output_gray16) options.gray16_output = "picture16.png";
+    if (output_pfm) options.pfm_output = "result.pfm";
+    if (tsv) options.text_format.separator = '\t';
+    if (options.text_format.precision < 0 ||
+        options.text_format.precision > 9) {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "precision");
+    }
+    if (periodicity_exact) options.periodicity_epsilon = 0.0f;
+    if (options.periodicity && options.kernel != Kernel::seeds) {
+      throw po::error("--periodicity requires --kernel seeds");
+    }
+
+    if (options.resume && options.checkpoint.empty()) {
+      throw po::error("--resume requires --checkpoint");
+    }
+
+    // a retired pixel keeps the orbit state of its retirement, not of the
+    // last iteration, so periodicity states could not be continued exactly
+    if (!options.save_state.empty() || !options.deepen.empty()) {
+      if (options.kernel != Kernel::seeds || options.adaptive ||
+          options.periodicity || options.resume) {
+        throw po::error("--save-state and --deepen require --kernel seeds and"
+                        " can not be combined with --adaptive, --periodicity"
+                        " or --resume");
+      }
+    }
+    if (!options.deepen.empty() &&
+        (!options.checkpoint.empty() || !shard.empty())) {
+      throw po::error("--deepen continues the whole grid and can not be"
+                      " combined with --checkpoint or --shard");
+    }
+
+    if (!shard.empty()) {
+      char separator;
+      std::istringstream shard_stream(shard);
+      if (!(shard_stream >> options.shard_index >> separator >>
+            options.num_shards) ||
+          separator != '/' || !shard_stream.eof() || options.num_shards < 1 ||
+          options.shard_index < 0 ||
+          options.shard_index >= options.num_shards) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "shard", shard);
+      }
+    }
+
+    if (scaling_repetitions < 1 ||
+        std::any_of(scaling_sizes.begin(), scaling_sizes.end(),
+                    [](int size) { return size < 1; })) {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "scaling");
+    }
+
+    if (options.tile_size < 1 || options.num_threads < 0) {
+      throw po::validation_error(po::validation_error::invalid_option_value);
+    }
+
+    if (sin_accuracy == "exact") {
+      options.sin_accuracy = SinAccuracy::exact;
+    } else if (sin_accuracy == "low") {
+      options.sin_accuracy = SinAccuracy::low;
+    } else if (sin_accuracy == "medium") {
+      options.sin_accuracy = SinAccuracy::medium;
+    } else if (sin_accuracy == "high") {
+      options.sin_accuracy = SinAccuracy::high;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "sin", sin_accuracy);
+    }
+
   } catch (po::error& e) {
     std::cerr << e.what() << std::endl;
     return -1;
   }
 
-  compute_all(
-    num_iterations,
-    threshold,
-    alphamin,
-    alphamax,
-    alpha_num_intervals,
-    betamin,
-    betamax,
-    beta_num_intervals,
-    num_seedpoints,
-    output_csv,
-    seedpoints
-  );
+  try {
+    if (!recolor.empty()) {
+      recolor_result(recolor, output_csv, options);
+      return 0;
+    }
+
+    if (!scaling.empty()) {
+      // threads up to --threads or the number of cores
+      GridParameters grid = {num_iterations, threshold, alphamin,
+                             alphamax, alpha_num_intervals, betamin,
+                             betamax, beta_num_intervals};
+      aligned_vector<float> seed_x, seed_y;
+      make_seed_points(num_seedpoints, seedpoints, seed_x, seed_y);
+      if (scaling_sizes.empty()) {
+        scaling_sizes.push_back(alpha_num_intervals + 1);
+      }
+      int max_threads = options.num_threads > 0 ? options.num_threads
+                                                : default_num_threads();
+      write_scaling(scaling,
+                    scaling_study(grid, seed_x, seed_y, options, scaling_sizes,
+                                  max_threads, scaling_repetitions));
+      std::cout << "scaling study written to " << scaling << ".csv and "
+                << scaling << ".json" << std::endl;
+      return 0;
+    }
+
+    compute_all(
+      num_iterations,
+      threshold,
+      alphamin,
+      alphamax,
+      alpha_num_intervals,
+      betamin,
+      betamax,
+      beta_num_intervals,
+      num_seedpoints,
+      output_csv,
+      seedpoints,
+      options
+    );
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
 
 }
@@ -6,7 +6,7 @@
 // released under the CC0 license
 // source: https://github.com/BIDS/colormap/blob/master/colormaps.py
 
-float const magma[256][3]= {
+constexpr float magma[256][3] = {
   {0.001462, 0.000466, 0.013866},
   {0.002258, 0.001295, 0.018331},
   {0.003279, 0.002305, 0.023708},
@@ -265,7 +265,7 @@ float const magma[256][3]= {
   {0.987053, 0.991438, 0.749504}
 };
 
-float const inferno[256][3] = {
+constexpr float inferno[256][3] = {
   {0.001462, 0.000466, 0.013866},
   {0.002267, 0.001270, 0.018570},
   {0.003299, 0.002249, 0.024239},
@@ -524,7 +524,7 @@ float const inferno[256][3] = {
   {0.988362, 0.998364, 0.644924}
 };
 
-float const plasma[256][3] = {
+constexpr float plasma[256][3] = {
   {0.050383, 0.029803, 0.527975},
   {0.063536, 0.028426, 0.533124},
   {0.075353, 0.027206, 0.538007},
@@ -783,7 +783,7 @@ float const plasma[256][3] = {
   {0.940015, 0.975158, 0.131326}
 };
 
-float const viridis[256][3] = {
+constexpr float viridis[256][3] = {
   {0.267004, 0.004874, 0.329415},
   {0.268510, 0.009605, 0.335427},
   {0.269944, 0.014625, 0.341379},
@@ -1042,4 +1042,26 @@ float const viridis[256][3] = {
   {0.993248, 0.906157, 0.143936}
 };
 
+// 8bit RGB lookup table of a colormap, entry i is floor(255 * map[i]) and
+// the extra entry 256 is white (escaped pixels)
+struct ColormapLut {
+  unsigned char rgb[257][3];
+};
+
+constexpr ColormapLut make_colormap_lut(const float (&map)[256][3]) {
+  ColormapLut lut{};
+  for (int i = 0; i < 256; i++) {
+    for (int c = 0; c < 3; c++) {
+      lut.rgb[i][c] = static_cast<unsigned char>(255 * map[i][c]);
+    }
+  }
+  for (int c = 0; c < 3; c++) lut.rgb[256][c] = 255;
+  return lut;
+}
+
+constexpr ColormapLut magma_lut = make_colormap_lut(magma);
+constexpr ColormapLut inferno_lut = make_colormap_lut(inferno);
+constexpr ColormapLut plasma_lut = make_colormap_lut(plasma);
+constexpr ColormapLut viridis_lut = make_colormap_lut(viridis);
+
 #endif
@@ -4,38 +4,76 @@
 #include <cmath>
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <fstream>
+#include <iomanip>
+#include <iterator>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "checkpoint.hpp"
+#include "gridcache.hpp"
+#include "instrumentation.hpp"
+#include "orbitstate.hpp"
 #include "picture.hpp"
+#include "rawresult.hpp"
+#include "render.hpp"
 
-constexpr float PI = 3.14159265358979323846264338327950288419716939f;
-constexpr float TWO_PI = 2 * PI;
+namespace {
+std::atomic<std::size_t> allocation_counter(0);
+}
 
-float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
-              const aligned_vector<float>& seed_y, int num_iterations,
-              float threshold) {
-  int num_seeds = seed_x.size();
-  assert(seed_y.size() == num_seeds);
+std::size_t aligned_allocations() { return allocation_counter.load(); }
 
-  aligned_vector<float> x = seed_x;
-  aligned_vector<float> y = seed_y;
+void count_aligned_allocation() {
+  allocation_counter.fetch_add(1, std::memory_order_relaxed);
+}
 
-  float* xp = x.data();
-  float* yp = y.data();
+namespace {
 
-  float d = 0.0;
+// x only enters the iteration through sin2pi, so for the polynomial tiers it
+// is kept in [-1/2, 1/2] to avoid losing precision while it drifts. The exact
+// tier keeps the original unreduced iteration.
+template <SinAccuracy A>
+inline float reduce_x(float x) {
+  return A == SinAccuracy::exact ? x : reduce_period(x);
+}
+
+// iterates the orbits stored in scratch.x and scratch.y, d is the maximum
+// of |y| reached so far
+template <SinAccuracy A>
+float iterate_impl(float alpha, float beta, int num_iterations,
+                   float threshold, float d, Scratch& scratch) {
+  int num_seeds = scratch.x.size();
+  assert(scratch.y.size() == static_cast<std::size_t>(num_seeds));
+
+  float* xp = scratch.x.data();
+  float* yp = scratch.y.data();
+  INSTRUMENT(scratch.iterations = 0;)
 
   for (int i = 0; i < num_iterations && d <= threshold; i++) {
+    INSTRUMENT(scratch.iterations++;)
 #pragma omp simd aligned(xp, yp : 64)
     for (int s = 0; s < num_seeds; s++) {
-      yp[s] = yp[s] + beta * std::sin(TWO_PI * xp[s]);
+      yp[s] = yp[s] + beta * sin2pi<A>(xp[s]);
     }
 #pragma omp simd aligned(xp, yp : 64)
     for (int s = 0; s < num_seeds; s++) {
-      xp[s] = xp[s] + alpha * std::sin(TWO_PI * yp[s]);
+      xp[s] = reduce_x<A>(xp[s] + alpha * sin2pi<A>(yp[s]));
     }
 
     for (int s = 0; s < num_seeds; s++) {
@@ -46,89 +84,1407 @@ float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
   return d;
 }
 
+template <SinAccuracy A>
+float compute_impl(float alpha, float beta, const aligned_vector<float>& seed_x,
+                   const aligned_vector<float>& seed_y, int num_iterations,
+                   float threshold, Scratch& scratch) {
+  assert(seed_y.size() == seed_x.size());
+  scratch.x.assign(seed_x.begin(), seed_x.end());
+  scratch.y.assign(seed_y.begin(), seed_y.end());
+  return iterate_impl<A>(alpha, beta, num_iterations, threshold, 0.0f,
+                         scratch);
+}
+
+// compute_impl with Brent's cycle detection on the state (x mod 1, y) of
+// every seed. A seed whose state returns to its saved state within epsilon
+// has visited its whole cycle, so it can not increase d anymore and is
+// dropped. When no seed is left the pixel is bounded.
+template <SinAccuracy A>
+float compute_periodic_impl(float alpha, float beta,
+                            const aligned_vector<float>& seed_x,
+                            const aligned_vector<float>& seed_y,
+                            int num_iterations, float threshold, float epsilon,
+                            Scratch& scratch) {
+  int num_seeds = seed_x.size();
+  assert(seed_y.size() == static_cast<std::size_t>(num_seeds));
+
+  scratch.x.assign(seed_x.begin(), seed_x.end());
+  scratch.y.assign(seed_y.begin(), seed_y.end());
+  scratch.saved_x.assign(seed_x.begin(), seed_x.end());
+  scratch.saved_y.assign(seed_y.begin(), seed_y.end());
+
+  float* xp = scratch.x.data();
+  float* yp = scratch.y.data();
+  float* saved_xp = scratch.saved_x.data();
+  float* saved_yp = scratch.saved_y.data();
+  int power = 1;
+  int steps = 0;
+
+  int num_active = num_seeds;  // active seeds are kept in front
+  float d = 0.0;
+  INSTRUMENT(scratch.iterations = 0;)
+
+  for (int i = 0; i < num_iterations && d <= threshold; i++) {
+    INSTRUMENT(scratch.iterations++;)
+#pragma omp simd aligned(xp, yp : 64)
+    for (int s = 0; s < num_active; s++) {
+      yp[s] = yp[s] + beta * sin2pi<A>(xp[s]);
+    }
+#pragma omp simd aligned(xp, yp : 64)
+    for (int s = 0; s < num_active; s++) {
+      xp[s] = reduce_x<A>(xp[s] + alpha * sin2pi<A>(yp[s]));
+    }
+
+    for (int s = 0; s < num_active; s++) {
+      d = std::max(d, std::abs(yp[s]));
+    }
+
+    int num_periodic = 0;
+#pragma omp simd aligned(xp, yp, saved_xp, saved_yp : 64) \
+    reduction(+ : num_periodic)
+    for (int s = 0; s < num_active; s++) {
+      float dx = std::abs(reduce_period(xp[s] - saved_xp[s]));
+      float dy = std::abs(yp[s] - saved_yp[s]);
+      num_periodic += std::islessequal(std::max(dx, dy), epsilon);
+    }
+
+    // move the periodic seeds behind the active ones
+    for (int s = 0; num_periodic > 0 && s < num_active;) {
+      float dx = std::abs(reduce_period(xp[s] - saved_xp[s]));
+      float dy = std::abs(yp[s] - saved_yp[s]);
+      if (std::max(dx, dy) <= epsilon) {
+        num_active--;
+        num_periodic--;
+        std::swap(xp[s], xp[num_active]);
+        std::swap(yp[s], yp[num_active]);
+        std::swap(saved_xp[s], saved_xp[num_active]);
+        std::swap(saved_yp[s], saved_yp[num_active]);
+        scratch.periodic_seeds++;
+      } else {
+        s++;
+      }
+    }
+
+    // Brent: the saved states move to the current ones after 1, 2, 4, ...
+    // steps, so any cycle is detected within twice its length. All seeds
+    // start together, so they share the step counter.
+    if (++steps == power) {
+      std::copy(xp, xp + num_active, saved_xp);
+      std::copy(yp, yp + num_active, saved_yp);
+      power *= 2;
+      steps = 0;
+    }
+
+    if (num_active == 0) {
+      scratch.periodic_pixels++;
+      break;
+    }
+  }
+
+  return d;
+}
+
+template <SinAccuracy A>
+void compute_row_impl(const float* alphas, int num_alphas, float beta,
+                      const aligned_vector<float>& seed_x,
+                      const aligned_vector<float>& seed_y, int num_iterations,
+                      float threshold, float* result, Scratch& scratch) {
+  int num_seeds = seed_x.size();
+  assert(seed_y.size() == static_cast<std::size_t>(num_seeds));
+
+  // state of seed s in lane l is stored at s * LANES + l
+  scratch.x.resize(num_seeds * LANES);
+  scratch.y.resize(num_seeds * LANES);
+  alignas(64) float alpha[LANES];
+  alignas(64) float d[LANES];
+  int iteration[LANES];
+  int pixel[LANES];  // index of the pixel in the lane, -1 if lane is idle
+
+  float* xp = scratch.x.data();
+  float* yp = scratch.y.data();
+
+  int next_pixel = 0;
+  int active_lanes = 0;
+
+  // loads the next pixel of the row into lane l, idle lanes are set to the
+  // fixpoint x = y = 0 (alpha = 0) so that they stay finite
+  auto refill = [&](int l) {
+    bool has_pixel = next_pixel < num_alphas;
+    pixel[l] = has_pixel ? next_pixel++ : -1;
+    alpha[l] = has_pixel ? alphas[pixel[l]] : 0.0f;
+    for (int s = 0; s < num_seeds; s++) {
+      xp[s * LANES + l] = has_pixel ? seed_x[s] : 0.0f;
+      yp[s * LANES + l] = has_pixel ? seed_y[s] : 0.0f;
+    }
+    d[l] = 0.0f;
+    iteration[l] = 0;
+    if (has_pixel) active_lanes++;
+  };
+
+  for (int l = 0; l < LANES; l++) refill(l);
+
+  while (active_lanes > 0) {
+    for (int s = 0; s < num_seeds; s++) {
+      float* xs = xp + s * LANES;
+      float* ys = yp + s * LANES;
+#pragma omp simd aligned(xs, ys, alpha, d : 64)
+      for (int l = 0; l < LANES; l++) {
+        ys[l] = ys[l] + beta * sin2pi<A>(xs[l]);
+        xs[l] = reduce_x<A>(xs[l] + alpha[l] * sin2pi<A>(ys[l]));
+        d[l] = std::max(d[l], std::abs(ys[l]));
+      }
+    }
+
+    // retire finished lanes and refill them with the next pixel of the row
+    for (int l = 0; l < LANES; l++) {
+      if (pixel[l] < 0) continue;
+      if (++iteration[l] >= num_iterations || d[l] > threshold) {
+        result[pixel[l]] = d[l];
+        INSTRUMENT(scratch.row_iterations[pixel[l]] = iteration[l];)
+        active_lanes--;
+        refill(l);
+      }
+    }
+  }
+}
+
+// fixed point phases have 32 fractional bits, sin(2 pi x) is interpolated
+// linearly from a table indexed by the top SIN_TABLE_BITS bits of the phase
+constexpr float FIXED_ONE = 4294967296.0f;  // 2^32
+constexpr int SIN_TABLE_BITS = 12;
+constexpr int SIN_TABLE_SIZE = 1 << SIN_TABLE_BITS;
+constexpr int SIN_FRAC_BITS = 32 - SIN_TABLE_BITS;
+
+// sin(2 pi k / SIN_TABLE_SIZE) for k = 0 .. SIN_TABLE_SIZE, the last entry
+// repeats the first one so that the interpolation needs no wraparound
+const float* sin_table() {
+  static const aligned_vector<float> table = [] {
+    aligned_vector<float> t(SIN_TABLE_SIZE + 1);
+    for (int k = 0; k <= SIN_TABLE_SIZE; k++) {
+      t[k] = std::sin(2.0 * M_PI * k / SIN_TABLE_SIZE);
+    }
+    return t;
+  }();
+  return table.data();
+}
+
+inline float sin_phase(const float* table, std::uint32_t phase) {
+  int index = phase >> SIN_FRAC_BITS;
+  int frac = phase & ((1u << SIN_FRAC_BITS) - 1);
+  float t = frac * (1.0f / (1 << SIN_FRAC_BITS));
+  return table[index] + t * (table[index + 1] - table[index]);
+}
+
+// x is an unsigned phase, wrapping around for free. y needs its integer part
+// for the threshold, so it is a signed Q32.32 number whose low 32 bits are
+// its phase.
+float compute_fixed_impl(float alpha, float beta,
+                         const aligned_vector<float>& seed_x,
+                         const aligned_vector<float>& seed_y,
+                         int num_iterations, float threshold,
+                         Scratch& scratch) {
+  int num_seeds = seed_x.size();
+  assert(seed_y.size() == static_cast<std::size_t>(num_seeds));
+
+  const float* table = sin_table();
+  scratch.phase_x.resize(num_seeds);
+  scratch.fixed_y.resize(num_seeds);
+  std::uint32_t* xp = scratch.phase_x.data();
+  std::int64_t* yp = scratch.fixed_y.data();
+  for (int s = 0; s < num_seeds; s++) {
+    xp[s] = static_cast<std::uint32_t>(
+        static_cast<std::int64_t>(std::floor(seed_x[s] * FIXED_ONE)));
+    yp[s] = static_cast<std::int64_t>(std::floor(seed_y[s] * FIXED_ONE));
+  }
+
+  const float alpha_fixed = alpha * FIXED_ONE;
+  const float beta_fixed = beta * FIXED_ONE;
+  std::int64_t d_fixed = 0;
+  const std::int64_t threshold_fixed =
+      static_cast<std::int64_t>(threshold * FIXED_ONE);
+  INSTRUMENT(scratch.iterations = 0;)
+
+  for (int i = 0; i < num_iterations && d_fixed <= threshold_fixed; i++) {
+    INSTRUMENT(scratch.iterations++;)
+#pragma omp simd aligned(xp, yp : 64)
+    for (int s = 0; s < num_seeds; s++) {
+      yp[s] += static_cast<std::int64_t>(beta_fixed * sin_phase(table, xp[s]));
+    }
+#pragma omp simd aligned(xp, yp : 64)
+    for (int s = 0; s < num_seeds; s++) {
+      std::uint32_t phase_y = static_cast<std::uint32_t>(yp[s]);
+      xp[s] += static_cast<std::uint32_t>(static_cast<std::int64_t>(
+          alpha_fixed * sin_phase(table, phase_y)));
+    }
+
+    for (int s = 0; s < num_seeds; s++) {
+      d_fixed = std::max(d_fixed, yp[s] < 0 ? -yp[s] : yp[s]);
+    }
+  }
+
+  return d_fixed / FIXED_ONE;
+}
+
+template <SinAccuracy A>
+float sin2pi_max_error_impl() {
+  const int num_samples = 1 << 20;
+  double max_error = 0.0;
+  for (int i = 0; i < num_samples; i++) {
+    // sample one period and a shifted copy to exercise the range reduction
+    for (float shift : {0.0f, -3.0f, 17.0f}) {
+      float x = static_cast<float>(i) / num_samples + shift;
+      double reference = std::sin(2.0 * M_PI * static_cast<double>(x));
+      double error = std::abs(sin2pi<A>(x) - reference);
+      max_error = std::max(max_error, error);
+    }
+  }
+  return max_error;
+}
+
+}  // namespace
+
+float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
+              const aligned_vector<float>& seed_y, int num_iterations,
+              float threshold) {
+  Scratch scratch;
+  return compute(alpha, beta, seed_x, seed_y, num_iterations, threshold,
+                 scratch);
+}
+
+float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
+              const aligned_vector<float>& seed_y, int num_iterations,
+              float threshold, Scratch& scratch, SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return compute_impl<SinAccuracy::low>(alpha, beta, seed_x, seed_y,
+                                            num_iterations, threshold, scratch);
+    case SinAccuracy::medium:
+      return compute_impl<SinAccuracy::medium>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, scratch);
+    case SinAccuracy::high:
+      return compute_impl<SinAccuracy::high>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, scratch);
+    default:
+      return compute_impl<SinAccuracy::exact>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, scratch);
+  }
+}
+
+void compute_row(const float* alphas, int num_alphas, float beta,
+                 const aligned_vector<float>& seed_x,
+                 const aligned_vector<float>& seed_y, int num_iterations,
+                 float threshold, float* result, Scratch& scratch,
+                 SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return compute_row_impl<SinAccuracy::low>(alphas, num_alphas, beta,
+                                                seed_x, seed_y, num_iterations,
+                                                threshold, result, scratch);
+    case SinAccuracy::medium:
+      return compute_row_impl<SinAccuracy::medium>(
+          alphas, num_alphas, beta, seed_x, seed_y, num_iterations, threshold,
+          result, scratch);
+    case SinAccuracy::high:
+      return compute_row_impl<SinAccuracy::high>(
+          alphas, num_alphas, beta, seed_x, seed_y, num_iterations, threshold,
+          result, scratch);
+    default:
+      return compute_row_impl<SinAccuracy::exact>(
+          alphas, num_alphas, beta, seed_x, seed_y, num_iterations, threshold,
+          result, scratch);
+  }
+}
+
+float compute_periodic(float alpha, float beta,
+                       const aligned_vector<float>& seed_x,
+                       const aligned_vector<float>& seed_y, int num_iterations,
+                       float threshold, float epsilon, Scratch& scratch,
+                       SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return compute_periodic_impl<SinAccuracy::low>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, epsilon,
+          scratch);
+    case SinAccuracy::medium:
+      return compute_periodic_impl<SinAccuracy::medium>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, epsilon,
+          scratch);
+    case SinAccuracy::high:
+      return compute_periodic_impl<SinAccuracy::high>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, epsilon,
+          scratch);
+    default:
+      return compute_periodic_impl<SinAccuracy::exact>(
+          alpha, beta, seed_x, seed_y, num_iterations, threshold, epsilon,
+          scratch);
+  }
+}
+
+float compute_continue(float alpha, float beta, const float* x,
+                       const float* y, int num_seeds, float d,
+                       int num_iterations, float threshold, Scratch& scratch,
+                       SinAccuracy accuracy) {
+  scratch.x.assign(x, x + num_seeds);
+  scratch.y.assign(y, y + num_seeds);
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return iterate_impl<SinAccuracy::low>(alpha, beta, num_iterations,
+                                            threshold, d, scratch);
+    case SinAccuracy::medium:
+      return iterate_impl<SinAccuracy::medium>(alpha, beta, num_iterations,
+                                               threshold, d, scratch);
+    case SinAccuracy::high:
+      return iterate_impl<SinAccuracy::high>(alpha, beta, num_iterations,
+                                             threshold, d, scratch);
+    default:
+      return iterate_impl<SinAccuracy::exact>(alpha, beta, num_iterations,
+                                              threshold, d, scratch);
+  }
+}
+
+float compute_fixed(float alpha, float beta,
+                    const aligned_vector<float>& seed_x,
+                    const aligned_vector<float>& seed_y, int num_iterations,
+                    float threshold, Scratch& scratch) {
+  return compute_fixed_impl(alpha, beta, seed_x, seed_y, num_iterations,
+                            threshold, scratch);
+}
+
+float sin2pi_max_error(SinAccuracy accuracy) {
+  switch (accuracy) {
+    case SinAccuracy::low:
+      return sin2pi_max_error_impl<SinAccuracy::low>();
+    case SinAccuracy::medium:
+      return sin2pi_max_error_impl<SinAccuracy::medium>();
+    case SinAccuracy::high:
+      return sin2pi_max_error_impl<SinAccuracy::high>();
+    default:
+      return sin2pi_max_error_impl<SinAccuracy::exact>();
+  }
+}
+
+namespace {
+
+// appends the orbit state left in the scratch for a bounded pixel
+void record_state(std::size_t pixel, Scratch& scratch) {
+  scratch.state_pixels.push_back(pixel);
+  scratch.state_x.insert(scratch.state_x.end(), scratch.x.begin(),
+                         scratch.x.end());
+  scratch.state_y.insert(scratch.state_y.end(), scratch.y.begin(),
+                         scratch.y.end());
+}
+
+// appends from to to and releases the memory of from, without a copy if to
+// is still empty
+template <typename T>
+void move_append(std::vector<T>& from, std::vector<T>& to) {
+  if (to.empty()) {
+    to.swap(from);
+  } else {
+    to.insert(to.end(), std::make_move_iterator(from.begin()),
+              std::make_move_iterator(from.end()));
+  }
+  std::vector<T>().swap(from);
+}
+
+// moves the recorded orbit states of a thread into state
+void collect_states(Scratch& scratch, OrbitState& state) {
+  move_append(scratch.state_pixels, state.pixels);
+  move_append(scratch.state_x, state.x);
+  move_append(scratch.state_y, state.y);
+}
+
+// num_threads scratches for a grid, the buffers of earlier grids are kept
+// but their counters and orbit states are reset
+void prepare_scratches(std::vector<Scratch>& scratches, int num_threads,
+                       bool record_state, std::uint32_t* pixel_iterations) {
+  scratches.resize(num_threads);
+  for (Scratch& scratch : scratches) {
+    scratch.periodic_pixels = 0;
+    scratch.periodic_seeds = 0;
+    scratch.record_state = record_state;
+    scratch.state_pixels.clear();
+    scratch.state_x.clear();
+    scratch.state_y.clear();
+    scratch.pixel_iterations = pixel_iterations;
+  }
+}
+
+// computes num_alphas neighbouring pixels with the same beta into result,
+// the first of them has the index first_pixel in the grid
+void compute_span(const float* alphas, int num_alphas, float beta,
+                  const aligned_vector<float>& seed_x,
+                  const aligned_vector<float>& seed_y, int num_iterations,
+                  float threshold, float* result, std::size_t first_pixel,
+                  Scratch& scratch, const ComputeOptions& options) {
+  // stores the iterations of the last pixel if instrumented
+  auto record_iterations = [&]([[maybe_unused]] int a) {
+    INSTRUMENT(if (scratch.pixel_iterations) {
+      scratch.pixel_iterations[first_pixel + a] = scratch.iterations;
+    })
+  };
+  if (options.kernel == Kernel::pixels) {
+    INSTRUMENT(scratch.row_iterations.resize(num_alphas);)
+    compute_row(alphas, num_alphas, beta, seed_x, seed_y, num_iterations,
+                threshold, result, scratch, options.sin_accuracy);
+    INSTRUMENT(if (scratch.pixel_iterations) {
+      std::copy(scratch.row_iterations.begin(),
+                scratch.row_iterations.begin() + num_alphas,
+                scratch.pixel_iterations + first_pixel);
+    })
+  } else if (options.kernel == Kernel::fixed) {
+    for (int a = 0; a < num_alphas; a++) {
+      result[a] = compute_fixed(alphas[a], beta, seed_x, seed_y,
+                                num_iterations, threshold, scratch);
+      record_iterations(a);
+    }
+  } else if (options.periodicity) {
+    for (int a = 0; a < num_alphas; a++) {
+      result[a] = compute_periodic(alphas[a], beta, seed_x, seed_y,
+                                   num_iterations, threshold,
+                                   options.periodicity_epsilon, scratch,
+                                   options.sin_accuracy);
+      record_iterations(a);
+      if (scratch.record_state && result[a] <= threshold) {
+        record_state(first_pixel + a, scratch);
+      }
+    }
+  } else {
+    for (int a = 0; a < num_alphas; a++) {
+      result[a] = compute(alphas[a], beta, seed_x, seed_y, num_iterations,
+                          threshold, scratch, options.sin_accuracy);
+      record_iterations(a);
+      if (scratch.record_state && result[a] <= threshold) {
+        record_state(first_pixel + a, scratch);
+      }
+    }
+  }
+}
+
+// iterations of the probe pixel which estimates the cost of a tile
+constexpr int PROBE_ITERATIONS = 256;
+
+// reorders the tiles such that tiles whose center pixel is still bounded
+// after PROBE_ITERATIONS come first, they are the expensive ones
+void order_by_cost(std::vector<Tile>& tiles,
+                   const aligned_vector<float>& alphas,
+                   const aligned_vector<float>& betas,
+                   const aligned_vector<float>& seed_x,
+                   const aligned_vector<float>& seed_y, int num_iterations,
+                   float threshold, Scratch& scratch) {
+  int beta_num_params = betas.size();
+  int probe_iterations = std::min(num_iterations, PROBE_ITERATIONS);
+  std::vector<char> expensive(tiles.size());
+  for (std::size_t i = 0; i < tiles.size(); i++) {
+    const Tile& tile = tiles[i];
+    float alpha = alphas[tile.x0 + tile.width / 2];
+    float beta = betas[beta_num_params - 1 - (tile.y0 + tile.height / 2)];
+    float probe = compute(alpha, beta, seed_x, seed_y, probe_iterations,
+                          threshold, scratch);
+    expensive[i] = probe <= threshold;
+  }
+  std::vector<Tile> ordered;
+  ordered.reserve(tiles.size());
+  for (int pass = 1; pass >= 0; pass--) {
+    for (std::size_t i = 0; i < tiles.size(); i++) {
+      if (expensive[i] == pass) ordered.push_back(tiles[i]);
+    }
+  }
+  tiles.swap(ordered);
+}
+
+// Mariani-Silver subdivision: the border of a block is computed, if it is
+// uniform the interior is filled by interpolating the border values,
+// otherwise the block is split into four along a computed cross and the
+// quadrants are handled the same way. Blocks include their border rows and
+// columns.
+class AdaptiveFill {
+ public:
+  AdaptiveFill(float* result, const aligned_vector<float>& alphas,
+               const aligned_vector<float>& betas,
+               const aligned_vector<float>& seed_x,
+               const aligned_vector<float>& seed_y, int num_iterations,
+               float threshold, const ComputeOptions& options,
+               Scratch& scratch)
+      : result_(result),
+        alphas_(alphas),
+        betas_(betas),
+        seed_x_(seed_x),
+        seed_y_(seed_y),
+        num_iterations_(num_iterations),
+        threshold_(threshold),
+        options_(options),
+        scratch_(scratch) {}
+
+  // computes the tile, returns the number of pixels filled without computing
+  std::size_t run(const Tile& tile) {
+    filled_ = 0;
+    int x1 = tile.x0 + tile.width - 1;
+    int y1 = tile.y0 + tile.height - 1;
+    compute_row(tile.y0, tile.x0, x1);
+    if (y1 > tile.y0) compute_row(y1, tile.x0, x1);
+    for (int r = tile.y0 + 1; r < y1; r++) {
+      compute_pixel(r, tile.x0);
+      if (x1 > tile.x0) compute_pixel(r, x1);
+    }
+    subdivide(tile.x0, tile.y0, x1, y1);
+    return filled_;
+  }
+
+ private:
+  float* pixel(int r, int c) { return result_ + r * alphas_.size() + c; }
+
+  // computes the pixels c0..c1 of row r
+  void compute_row(int r, int c0, int c1) {
+    if (c1 < c0) return;
+    compute_span(alphas_.data() + c0, c1 - c0 + 1,
+                 betas_[betas_.size() - 1 - r], seed_x_, seed_y_,
+                 num_iterations_, threshold_, pixel(r, c0),
+                 r * alphas_.size() + c0, scratch_, options_);
+  }
+
+  void compute_pixel(int r, int c) { compute_row(r, c, c); }
+
+  // the border of the block x0..x1, y0..y1 is already computed
+  void subdivide(int x0, int y0, int x1, int y1) {
+    if (x1 - x0 < 2 || y1 - y0 < 2) return;  // no interior
+
+    if (x1 - x0 < 4 || y1 - y0 < 4) {
+      for (int r = y0 + 1; r < y1; r++) compute_row(r, x0 + 1, x1 - 1);
+      return;
+    }
+
+    float min_value, max_value;
+    if (uniform_border(x0, y0, x1, y1, min_value, max_value)) {
+      fill(x0, y0, x1, y1, min_value, max_value);
+      filled_ += static_cast<std::size_t>(x1 - x0 - 1) * (y1 - y0 - 1);
+      return;
+    }
+
+    int xm = (x0 + x1) / 2;
+    int ym = (y0 + y1) / 2;
+    compute_row(ym, x0 + 1, x1 - 1);
+    for (int r = y0 + 1; r < y1; r++) {
+      if (r != ym) compute_pixel(r, xm);
+    }
+    subdivide(x0, y0, xm, ym);
+    subdivide(xm, y0, x1, ym);
+    subdivide(x0, ym, xm, y1);
+    subdivide(xm, ym, x1, y1);
+  }
+
+  // a border is uniform if all its pixels escaped, or if there is a
+  // tolerance and all are bounded (they ran all iterations) with values
+  // differing by at most the tolerance
+  bool uniform_border(int x0, int y0, int x1, int y1, float& min_value,
+                      float& max_value) {
+    min_value = *pixel(y0, x0);
+    max_value = min_value;
+    int num_escaped = 0;
+    int num_pixels = 0;
+    auto visit = [&](int r, int c) {
+      float value = *pixel(r, c);
+      min_value = std::min(min_value, value);
+      max_value = std::max(max_value, value);
+      num_escaped += value > threshold_;
+      num_pixels++;
+    };
+    for (int c = x0; c <= x1; c++) {
+      visit(y0, c);
+      visit(y1, c);
+    }
+    for (int r = y0 + 1; r < y1; r++) {
+      visit(r, x0);
+      visit(r, x1);
+    }
+    if (num_escaped == num_pixels) return true;
+    return num_escaped == 0 && options_.adaptive_tolerance >= 0 &&
+           max_value - min_value <= options_.adaptive_tolerance;
+  }
+
+  // the mean of the linear interpolations between the left and right and
+  // between the top and bottom border, clamped to the border values so that
+  // an escaped block stays escaped
+  void fill(int x0, int y0, int x1, int y1, float min_value,
+            float max_value) {
+    float width = x1 - x0;
+    float height = y1 - y0;
+    for (int r = y0 + 1; r < y1; r++) {
+      float left = *pixel(r, x0);
+      float right = *pixel(r, x1);
+      float v = (r - y0) / height;
+      for (int c = x0 + 1; c < x1; c++) {
+        float u = (c - x0) / width;
+        float value = 0.5f * ((1 - u) * left + u * right +
+                              (1 - v) * *pixel(y0, c) + v * *pixel(y1, c));
+        *pixel(r, c) = std::min(std::max(value, min_value), max_value);
+      }
+    }
+  }
+
+  float* result_;
+  const aligned_vector<float>& alphas_;
+  const aligned_vector<float>& betas_;
+  const aligned_vector<float>& seed_x_;
+  const aligned_vector<float>& seed_y_;
+  int num_iterations_;
+  float threshold_;
+  const ComputeOptions& options_;
+  Scratch& scratch_;
+  std::size_t filled_ = 0;
+};
+
+}  // namespace
+
+GridStats compute_grid(float* result, const aligned_vector<float>& alphas,
+                       const aligned_vector<float>& betas,
+                       const aligned_vector<float>& seed_x,
+                       const aligned_vector<float>& seed_y, int num_iterations,
+                       float threshold, const ComputeOptions& options,
+                       Checkpoint* checkpoint, OrbitState* orbit_state,
+                       Instrumentation* instrumentation,
+                       GridWorkspace* workspace) {
+  GridWorkspace call_workspace;
+  if (!workspace) workspace = &call_workspace;
+  std::vector<Scratch>& scratches = workspace->scratches;
+  auto cancelled = [&] {
+    return workspace->cancel && workspace->cancel->load();
+  };
+  int alpha_num_params = alphas.size();
+  int beta_num_params = betas.size();
+  GridStats stats;
+  std::uint32_t* pixel_iterations = nullptr;
+  INSTRUMENT(if (instrumentation) {
+    instrumentation->pixel_iterations.assign(
+        static_cast<std::size_t>(alpha_num_params) * beta_num_params, 0);
+    instrumentation->tiles.clear();
+    pixel_iterations = instrumentation->pixel_iterations.data();
+  })
+  // timing of one tile, stored by the caller
+  using Clock = std::chrono::steady_clock;
+  [[maybe_unused]] auto seconds_since = [](Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  if (options.schedule == Schedule::rows && !options.adaptive &&
+      !checkpoint && options.num_shards == 1) {
+    prepare_scratches(scratches, default_num_threads(),
+                      orbit_state != nullptr, pixel_iterations);
+#pragma omp parallel
+    {
+      int thread = 0;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+#endif
+      Scratch& scratch = scratches[thread];  // reused for all its pixels
+      std::vector<TileTiming> timings;
+#pragma omp for schedule(dynamic)
+      for (int b = beta_num_params - 1; b >= 0; b--) {
+        if (cancelled()) continue;
+        INSTRUMENT(Clock::time_point row_start = Clock::now();)
+        std::size_t first_pixel =
+            static_cast<std::size_t>(beta_num_params - b - 1) *
+            alpha_num_params;
+        compute_span(alphas.data(), alpha_num_params, betas[b], seed_x,
+                     seed_y, num_iterations, threshold, result + first_pixel,
+                     first_pixel, scratch, options);
+        INSTRUMENT(if (instrumentation) {
+          timings.push_back({{0, beta_num_params - b - 1, alpha_num_params, 1},
+                             thread, seconds_since(row_start)});
+        })
+      }
+#pragma omp critical
+      {
+        stats.add_counters(scratch);
+        if (orbit_state) collect_states(scratch, *orbit_state);
+        if (instrumentation) {
+          instrumentation->tiles.insert(instrumentation->tiles.end(),
+                                        timings.begin(), timings.end());
+        }
+      }
+    }
+    stats.cancelled = cancelled();
+    return stats;
+  }
+
+  std::vector<Tile> tiles =
+      make_tiles(alpha_num_params, beta_num_params, options.tile_size);
+  if (options.num_shards > 1) {
+    // diagonal interleaving gives every shard a mix of all regions
+    tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                               [&](const Tile& tile) {
+                                 int shard = (tile.x0 / options.tile_size +
+                                              tile.y0 / options.tile_size) %
+                                             options.num_shards;
+                                 return shard != options.shard_index;
+                               }),
+                tiles.end());
+  }
+  if (checkpoint) {
+    tiles.erase(std::remove_if(tiles.begin(), tiles.end(),
+                               [&](const Tile& tile) {
+                                 return checkpoint->finished(tile);
+                               }),
+                tiles.end());
+  }
+  order_by_cost(tiles, alphas, betas, seed_x, seed_y, num_iterations,
+                threshold, workspace->probe);
+
+  int num_threads =
+      options.num_threads > 0 ? options.num_threads : default_num_threads();
+  if (!workspace->pool || workspace->pool->num_threads() != num_threads) {
+    workspace->pool.reset(new TilePool(num_threads));
+  }
+  prepare_scratches(scratches, num_threads, orbit_state != nullptr,
+                    pixel_iterations);
+  std::vector<std::size_t> filled(num_threads);
+  std::vector<std::vector<TileTiming>> timings(num_threads);
+
+  stats.threads =
+      workspace->pool->run(tiles, [&](const Tile& tile, int thread) {
+        if (cancelled()) return;  // not saved to the checkpoint either
+        INSTRUMENT(Clock::time_point tile_start = Clock::now();)
+        if (options.adaptive) {
+          AdaptiveFill adaptive(result, alphas, betas, seed_x, seed_y,
+                                num_iterations, threshold, options,
+                                scratches[thread]);
+          filled[thread] += adaptive.run(tile);
+        } else {
+          for (int r = tile.y0; r < tile.y0 + tile.height; r++) {
+            if (cancelled()) return;
+            std::size_t first_pixel =
+                static_cast<std::size_t>(r) * alpha_num_params + tile.x0;
+            compute_span(alphas.data() + tile.x0, tile.width,
+                         betas[beta_num_params - 1 - r], seed_x, seed_y,
+                         num_iterations, threshold, result + first_pixel,
+                         first_pixel, scratches[thread], options);
+          }
+        }
+        INSTRUMENT(if (instrumentation) {
+          timings[thread].push_back({tile, thread, seconds_since(tile_start)});
+        })
+        if (checkpoint) checkpoint->save(tile);
+      });
+  stats.cancelled = cancelled();
+  for (std::size_t f : filled) stats.filled_pixels += f;
+  for (Scratch& scratch : scratches) {
+    stats.add_counters(scratch);
+    if (orbit_state) collect_states(scratch, *orbit_state);
+  }
+  if (instrumentation) {
+    for (const std::vector<TileTiming>& thread_timings : timings) {
+      instrumentation->tiles.insert(instrumentation->tiles.end(),
+                                    thread_timings.begin(),
+                                    thread_timings.end());
+    }
+    instrumentation->threads = stats.threads;
+  }
+  return stats;
+}
+
+GridStats stream_grid(const aligned_vector<float>& alphas,
+                      const aligned_vector<float>& betas,
+                      const aligned_vector<float>& seed_x,
+                      const aligned_vector<float>& seed_y, int num_iterations,
+                      float threshold, const ComputeOptions& options,
+                      const std::function<void(const float*)>& sink,
+                      GridWorkspace* workspace) {
+  GridWorkspace call_workspace;
+  if (!workspace) workspace = &call_workspace;
+  int alpha_num_params = alphas.size();
+  int beta_num_params = betas.size();
+  int num_threads =
+      options.num_threads > 0 ? options.num_threads : default_num_threads();
+  int window = options.stream_window > 0 ? options.stream_window
+                                         : 4 * num_threads;
+  window = std::max(window, num_threads);
+
+  // row r lives in slot r % window until it is written
+  aligned_vector<float> rows(static_cast<std::size_t>(window) *
+                             alpha_num_params);
+  std::vector<char> done(window, 0);
+  std::mutex mutex;
+  std::condition_variable row_written;
+  int next_row = 0;     // next row to compute
+  int written = 0;      // rows passed to the sink
+  bool writing = false;  // a worker is calling the sink
+  std::exception_ptr error;
+
+  GridStats stats;
+  stats.threads.resize(num_threads);
+  std::vector<Scratch>& scratches = workspace->scratches;
+  prepare_scratches(scratches, num_threads, false, nullptr);
+  auto time_start = std::chrono::steady_clock::now();
+
+  auto worker = [&](int thread) {
+    ThreadStats& own = stats.threads[thread];
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      // the row of the oldest unwritten slot is always being computed, so
+      // waiting for the window to advance can not deadlock
+      row_written.wait(lock, [&] {
+        return error || next_row >= beta_num_params ||
+               next_row < written + window;
+      });
+      if (error || next_row >= beta_num_params) break;
+      int r = next_row++;
+      lock.unlock();
+
+      auto row_start = std::chrono::steady_clock::now();
+      float* row = rows.data() + static_cast<std::size_t>(r % window) *
+                                     alpha_num_params;
+      compute_span(alphas.data(), alpha_num_params,
+                   betas[beta_num_params - 1 - r], seed_x, seed_y,
+                   num_iterations, threshold, row,
+                   static_cast<std::size_t>(r) * alpha_num_params,
+                   scratches[thread], options);
+      own.busy_seconds += std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - row_start)
+                              .count();
+      own.tiles++;
+
+      lock.lock();
+      done[r % window] = 1;
+      if (writing) continue;
+      // pass on the finished prefix, other workers go on meanwhile
+      writing = true;
+      while (!error && written < beta_num_params && done[written % window]) {
+        int w = written;
+        lock.unlock();
+        try {
+          sink(rows.data() +
+               static_cast<std::size_t>(w % window) * alpha_num_params);
+        } catch (...) {
+          lock.lock();
+          error = std::current_exception();
+          break;
+        }
+        lock.lock();
+        done[w % window] = 0;
+        written++;
+        row_written.notify_all();
+      }
+      writing = false;
+      row_written.notify_all();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) threads.emplace_back(worker, t);
+  worker(0);
+  for (std::thread& thread : threads) thread.join();
+  if (error) std::rethrow_exception(error);
+
+  double elapsed_seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - time_start)
+                               .count();
+  for (ThreadStats& s : stats.threads) {
+    s.idle_seconds = std::max(0.0, elapsed_seconds - s.busy_seconds);
+  }
+  for (Scratch& scratch : scratches) stats.add_counters(scratch);
+  return stats;
+}
+
+GridStats deepen_grid(float* result, const aligned_vector<float>& alphas,
+                      const aligned_vector<float>& betas,
+                      const OrbitState& state, int num_iterations,
+                      float threshold, const ComputeOptions& options,
+                      OrbitState* orbit_state, GridWorkspace* workspace) {
+  GridWorkspace call_workspace;
+  if (!workspace) workspace = &call_workspace;
+  std::vector<Scratch>& scratches = workspace->scratches;
+  prepare_scratches(scratches, default_num_threads(), false, nullptr);
+  int alpha_num_params = alphas.size();
+  int beta_num_params = betas.size();
+  int num_seeds = state.num_seeds;
+  int extra_iterations = num_iterations - state.iterations;
+  std::copy(state.result.begin(), state.result.end(), result);
+
+  GridStats stats;
+  long long num_pixels = state.pixels.size();
+#pragma omp parallel
+  {
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    Scratch& scratch = scratches[thread];
+#pragma omp for schedule(dynamic, 64)
+    for (long long i = 0; i < num_pixels; i++) {
+      std::size_t pixel = state.pixels[i];
+      int r = pixel / alpha_num_params;
+      int c = pixel % alpha_num_params;
+      result[pixel] = compute_continue(
+          alphas[c], betas[beta_num_params - 1 - r], &state.x[i * num_seeds],
+          &state.y[i * num_seeds], num_seeds, state.result[pixel],
+          extra_iterations, threshold, scratch, options.sin_accuracy);
+      if (orbit_state && result[pixel] <= threshold) {
+        record_state(pixel, scratch);
+      }
+    }
+#pragma omp critical
+    if (orbit_state) collect_states(scratch, *orbit_state);
+  }
+  return stats;
+}
+
+std::string describe_parameters(int num_iterations, float threshold,
+                                float alphamin, float alphamax,
+                                int alpha_num_intervals, float betamin,
+                                float betamax, int beta_num_intervals,
+                                const aligned_vector<float>& seed_x,
+                                const aligned_vector<float>& seed_y,
+                                const ComputeOptions& options) {
+  std::ostringstream description;
+  description.imbue(std::locale::classic());
+  description << std::setprecision(std::numeric_limits<float>::max_digits10);
+  description << "iterations " << num_iterations << '\n'
+              << "threshold " << threshold << '\n'
+              << "alpha " << alphamin << ' ' << alphamax << ' '
+              << alpha_num_intervals << '\n'
+              << "beta " << betamin << ' ' << betamax << ' '
+              << beta_num_intervals << '\n'
+              << "seeds_x";
+  for (float x : seed_x) description << ' ' << x;
+  description << "\nseeds_y";
+  for (float y : seed_y) description << ' ' << y;
+  description << "\nkernel " << static_cast<int>(options.kernel) << '\n'
+              << "sin_accuracy " << static_cast<int>(options.sin_accuracy)
+              << '\n'
+              << "adaptive " << options.adaptive << ' '
+              << options.adaptive_tolerance << '\n';
+  // the filled blocks follow the tiles, so the adaptive result depends on
+  // their size
+  if (options.adaptive) {
+    description << "tile_size " << options.tile_size << '\n';
+  }
+  description << "periodicity " << options.periodicity << ' '
+              << options.periodicity_epsilon << '\n';
+  return description.str();
+}
+
+GridParameters parse_parameters(const std::string& parameters) {
+  GridParameters grid;
+  std::istringstream lines(parameters);
+  std::string line;
+  bool have_iterations = false, have_threshold = false, have_alpha = false,
+       have_beta = false;
+  while (std::getline(lines, line)) {
+    std::istringstream fields(line);
+    fields.imbue(std::locale::classic());
+    std::string key;
+    fields >> key;
+    if (key == "iterations") {
+      have_iterations = static_cast<bool>(fields >> grid.num_iterations);
+    } else if (key == "threshold") {
+      have_threshold = static_cast<bool>(fields >> grid.threshold);
+    } else if (key == "alpha") {
+      have_alpha = static_cast<bool>(fields >> grid.alphamin >>
+                                     grid.alphamax >>
+                                     grid.alpha_num_intervals);
+    } else if (key == "beta") {
+      have_beta = static_cast<bool>(fields >> grid.betamin >> grid.betamax >>
+                                    grid.beta_num_intervals);
+    }
+  }
+  if (!have_iterations || !have_threshold || !have_alpha || !have_beta) {
+    throw std::runtime_error("incomplete parameter description:\n" +
+                             parameters);
+  }
+  return grid;
+}
+
+void compare_grids(const float* result, const float* reference,
+                   std::size_t size, float threshold, const std::string& name) {
+  double sum_difference = 0.0;
+  float max_difference = 0.0f;
+  std::size_t class_mismatches = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    bool escaped = result[i] > threshold;
+    if (escaped != (reference[i] > threshold)) {
+      class_mismatches++;
+    } else if (!escaped) {
+      float difference = std::abs(result[i] - reference[i]);
+      sum_difference += difference;
+      max_difference = std::max(max_difference, difference);
+    }
+  }
+  std::size_t num_compared = size - class_mismatches;
+  std::cout << "Comparison with " << name << ":\n"
+            << "  pixels with different escape: " << class_mismatches << " of "
+            << size << '\n'
+            << "  bounded pixels max abs difference: " << max_difference
+            << '\n'
+            << "  bounded pixels mean abs difference: "
+            << (num_compared > 0 ? sum_difference / num_compared : 0.0)
+            << std::endl;
+}
+
+aligned_vector<float> parameter_values(float min, float max,
+                                       int num_intervals) {
+  float interval_size = (max - min) / num_intervals;
+  aligned_vector<float> values(num_intervals + 1);
+  float* valuesp = values.data();
+#pragma omp simd aligned(valuesp : 64)
+  for (int i = 0; i < num_intervals + 1; i++) {
+    valuesp[i] = min + i * interval_size;
+  }
+  return values;
+}
+
+void make_seed_points(int num_seedpoints, const std::vector<float>& seedpoints,
+                      aligned_vector<float>& seed_x,
+                      aligned_vector<float>& seed_y) {
+  int num_uniform = num_seedpoints - seedpoints.size();
+  seed_x.assign(num_seedpoints, 0.0f);
+  seed_y.assign(num_seedpoints, 0.0f);
+  for (int i = 1; i < num_uniform + 1; ++i) {
+    seed_x[i - 1] = 0.5f * static_cast<float>(i) / (num_uniform + 1);
+  }
+  for (std::size_t i = 0; i < seedpoints.size(); ++i) {
+    seed_x[num_uniform + i] = seedpoints[i];
+  }
+}
+
 void compute_all(int num_iterations, float threshold, float alphamin,
                  float alphamax, int alpha_num_intervals, float betamin,
                  float betamax, int beta_num_intervals, int num_seedpoints,
-                 bool output_csv, std::vector<float> seedpoints) {
+                 bool output_csv, std::vector<float> seedpoints,
+                 const ComputeOptions& options) {
   // these are computed
   int alpha_num_params = alpha_num_intervals + 1;
-  float alpha_interval_size = (alphamax - alphamin) / (alpha_num_intervals);
   int beta_num_params = beta_num_intervals + 1;
-  float beta_interval_size = (betamax - betamin) / (beta_num_intervals);
 
-  // fill prametervectors alpha and beta
-  aligned_vector<float> alphas(alpha_num_params);
-  float* alphasp = alphas.data();
-#pragma omp simd aligned(alphasp : 64)
-  for (int i = 0; i < alpha_num_params; i++) {
-    alphasp[i] = alphamin + i * alpha_interval_size;
+  ParameterGrid grid;
+  grid.num_iterations = num_iterations;
+  grid.threshold = threshold;
+  grid.alphamin = alphamin;
+  grid.alphamax = alphamax;
+  grid.alpha_num_intervals = alpha_num_intervals;
+  grid.betamin = betamin;
+  grid.betamax = betamax;
+  grid.beta_num_intervals = beta_num_intervals;
+  grid.num_seedpoints = num_seedpoints;
+  grid.seedpoints = seedpoints;
+
+  // every mode is computed by this engine, the outputs use its parameter
+  // values and seed points
+  RenderEngine engine(options);
+  engine.prepare(grid);
+  const aligned_vector<float>& alphas = engine.alphas();
+  const aligned_vector<float>& betas = engine.betas();
+  const aligned_vector<float>& x_start = engine.seed_x();
+  const aligned_vector<float>& y_start = engine.seed_y();
+
+  // Output of seedpoints
+  std::cout << "Following seedpoints are used for computation:" << std::endl;
+  for (float x : x_start) std::cout << x << ", ";
+  std::cout << '\n';
+
+  if (options.sin_accuracy != SinAccuracy::exact) {
+    std::cout << "sin2pi max error vs std::sin: "
+              << sin2pi_max_error(options.sin_accuracy) << std::endl;
   }
-  aligned_vector<float> betas(beta_num_params);
-  float* betasp = betas.data();
-#pragma omp simd aligned(betasp : 64)
-  for (int i = 0; i < beta_num_params; i++) {
-    betasp[i] = betamin + i * beta_interval_size;
+
+  if (options.stream) {
+    auto time_start = std::chrono::system_clock::now();
+    std::vector<std::unique_ptr<RowWriter>> images =
+        open_images(threshold, alpha_num_params, beta_num_params, options);
+    GridStats grid_stats = engine.stream(grid, [&](const float* row) {
+      for (auto& image : images) image->write_row(row);
+    });
+    for (auto& image : images) image->finish();
+    float elapsed_seconds = std::chrono::duration<float>(
+                                std::chrono::system_clock::now() - time_start)
+                                .count();
+    std::cout << "TIME for computation and picture: " << elapsed_seconds
+              << std::endl;
+    for (std::size_t t = 0; t < grid_stats.threads.size(); t++) {
+      std::cout << "  thread " << t << ": busy "
+                << grid_stats.threads[t].busy_seconds << ", idle "
+                << grid_stats.threads[t].idle_seconds << ", rows "
+                << grid_stats.threads[t].tiles << "\n";
+    }
+    return;
   }
 
-  // Initialization and output of seedpoints
-  std::cout << "Following seedpoints are used for computation:" << std::endl;
-  aligned_vector<float> x_start(num_seedpoints);
-  aligned_vector<float> y_start(num_seedpoints);
-  for (int i = 1; i < num_seedpoints - seedpoints.size() + 1; ++i) {
-    x_start[i - 1] =
-        0.5f * static_cast<float>(i) / (num_seedpoints - seedpoints.size() + 1);
-    //    y_start[i - 1] = 0;
-    std::cout << x_start[i - 1] << ", ";
-  }
-  for (int i = 0; i < seedpoints.size(); ++i) {
-    x_start[num_seedpoints - seedpoints.size() + i] = seedpoints[i];
-    //    y_start[num_seedpoints - seedpoints.size() + i] = 0;
-    std::cout << x_start[num_seedpoints - seedpoints.size() + i] << ", ";
+  std::string parameters =
+      describe_parameters(num_iterations, threshold, alphamin, alphamax,
+                          alpha_num_intervals, betamin, betamax,
+                          beta_num_intervals, x_start, y_start, options);
+
+  // Initialization pixel values, out of core directly in the raw file
+  const std::size_t num_pixels =
+      static_cast<std::size_t>(alpha_num_params) * beta_num_params;
+  aligned_vector<float> result_buffer;
+  std::unique_ptr<MappedRawResult> mapped_result;
+  if (options.out_of_core) {
+    mapped_result.reset(new MappedRawResult(options.raw_output, parameters,
+                                            alpha_num_params,
+                                            beta_num_params));
+  } else {
+    result_buffer.resize(num_pixels);
   }
-  std::cout << '\n';
+  float* result =
+      mapped_result ? mapped_result->data() : result_buffer.data();
 
-  // Initialization pixel values and color vectors
-  aligned_vector<float> result(alpha_num_params * beta_num_params);
+  // a shard records its tiles in a checkpoint file, dynamicsystems-merge
+  // assembles them
+  std::string checkpoint_file = options.checkpoint;
+  if (checkpoint_file.empty() && options.num_shards > 1) {
+    checkpoint_file = "shard_" + std::to_string(options.shard_index) + "_of_" +
+                      std::to_string(options.num_shards) + ".ckpt";
+  }
+
+  std::unique_ptr<Checkpoint> checkpoint;
+  if (!checkpoint_file.empty()) {
+    // the recorded tiles also depend on the tile size, so a resume with
+    // another one is refused as well
+    std::string checkpoint_parameters =
+        parameters + "checkpoint_tile_size " +
+        std::to_string(options.tile_size) + '\n';
+    checkpoint.reset(new Checkpoint(checkpoint_file, checkpoint_parameters,
+                                    alpha_num_params, beta_num_params,
+                                    result, options.resume,
+                                    options.checkpoint_interval));
+  }
+
+  OrbitState previous_state;
+  if (!options.deepen.empty()) {
+    previous_state = read_orbit_state(options.deepen);
+    if (previous_state.parameters !=
+            parameters_without_iterations(parameters) ||
+        previous_state.width != alpha_num_params ||
+        previous_state.height != beta_num_params ||
+        previous_state.num_seeds != num_seedpoints) {
+      throw std::runtime_error("orbit state " + options.deepen +
+                               " was written with different parameters:\n" +
+                               previous_state.parameters);
+    }
+    if (previous_state.iterations > num_iterations) {
+      throw std::runtime_error("orbit state " + options.deepen + " has " +
+                               std::to_string(previous_state.iterations) +
+                               " iterations, more than requested");
+    }
+    std::cout << "deepening " << previous_state.pixels.size()
+              << " bounded pixels from " << previous_state.iterations
+              << " to " << num_iterations << " iterations" << std::endl;
+  }
+
+  std::unique_ptr<OrbitState> orbit_state;
+  if (!options.save_state.empty()) {
+    orbit_state.reset(new OrbitState);
+    orbit_state->parameters = parameters_without_iterations(parameters);
+    orbit_state->iterations = num_iterations;
+    orbit_state->width = alpha_num_params;
+    orbit_state->height = beta_num_params;
+    orbit_state->num_seeds = num_seedpoints;
+  }
 
   auto time_start = std::chrono::system_clock::now();
+  std::size_t allocations_start = aligned_allocations();
 
   // Computation
-#pragma omp parallel for schedule(dynamic)
-  for (int b = beta_num_params - 1; b >= 0; b--) {
-    for (int a = 0; a < alpha_num_params; a++) {
-      result[(beta_num_params - b - 1) * alpha_num_params + a] = compute(
-          alphas[a], betas[b], x_start, y_start, num_iterations, threshold);
+  std::unique_ptr<Instrumentation> instrumentation;
+  if (!options.report.empty() || !options.cost_map.empty()) {
+    instrumentation.reset(new Instrumentation);
+  }
+  // runs which need more than the result can take it from the cache
+  std::unique_ptr<GridCache> cache;
+  if (!options.cache_dir.empty() && !mapped_result && !checkpoint &&
+      !orbit_state && options.deepen.empty() && !instrumentation) {
+    // the cache is optional, a directory which can not be created only
+    // loses the reuse
+    try {
+      cache.reset(new GridCache(options.cache_dir, options.cache_max_bytes));
+    } catch (std::runtime_error& e) {
+      std::cerr << "cache not used: " << e.what() << std::endl;
     }
   }
+  bool cached = cache && cache->load(parameters, result, alpha_num_params,
+                                     beta_num_params);
+  GridStats grid_stats;
+  if (cached) {
+    std::cout << "result loaded from cache " << cache->filename(parameters)
+              << std::endl;
+  } else if (mapped_result) {
+    grid_stats = engine.render(grid, *mapped_result);
+  } else if (options.deepen.empty()) {
+    grid_stats = engine.render(grid, result, checkpoint.get(),
+                               orbit_state.get(), instrumentation.get());
+  } else {
+    grid_stats = engine.deepen(grid, result, previous_state, orbit_state.get());
+  }
+  checkpoint.reset();
+  const std::vector<ThreadStats>& thread_stats = grid_stats.threads;
   auto time_end = std::chrono::system_clock::now();
   float elapsed_seconds =
       std::chrono::duration<float>(time_end - time_start).count();
-  std::cout << "TIME for computation: " << elapsed_seconds << std::endl;
+  const float compute_seconds = elapsed_seconds;
+  std::cout << "TIME for computation: " << elapsed_seconds
+            << " (allocations: " << aligned_allocations() - allocations_start
+            << ")" << std::endl;
+  for (std::size_t t = 0; t < thread_stats.size(); t++) {
+    std::cout << "  thread " << t << ": busy " << thread_stats[t].busy_seconds
+              << ", idle " << thread_stats[t].idle_seconds << ", tiles "
+              << thread_stats[t].tiles << " (stolen " << thread_stats[t].stolen
+              << ")\n";
+  }
+  if (options.periodicity && !cached) {
+    std::cout << "  periodicity: " << grid_stats.periodic_pixels
+              << " pixels retired early, " << grid_stats.periodic_seeds
+              << " periodic seed orbits\n";
+  }
+  if (options.adaptive && !cached) {
+    std::cout << "  adaptive: " << grid_stats.filled_pixels << " of "
+              << num_pixels << " pixels filled without computing\n";
+  }
+  if (cache && !cached) {
+    // the outputs do not depend on the cache, a full disk or an unwritable
+    // directory only loses the reuse
+    try {
+      cache->store(parameters, result, alpha_num_params, beta_num_params);
+    } catch (std::runtime_error& e) {
+      std::cerr << "result not cached: " << e.what() << std::endl;
+    }
+  }
 
+  if (instrumentation) {
+    if (!options.report.empty()) {
+      write_report(options.report, *instrumentation, result, alpha_num_params,
+                   beta_num_params, num_iterations, threshold,
+                   elapsed_seconds);
+      std::cout << "report written to " << options.report << std::endl;
+    }
+    if (!options.cost_map.empty()) {
+      write_cost_map(options.cost_map, *instrumentation, alpha_num_params,
+                     beta_num_params, num_iterations, options.png);
+      std::cout << "cost map written to " << options.cost_map << std::endl;
+    }
+  }
+
+  if (orbit_state) {
+    orbit_state->result.assign(result, result + num_pixels);
+    sort_pixels(*orbit_state);
+    write_orbit_state(options.save_state, *orbit_state);
+    std::cout << "orbit states of " << orbit_state->pixels.size()
+              << " bounded pixels saved to " << options.save_state
+              << std::endl;
+  }
+
+  if (options.num_shards > 1) {
+    std::cout << "shard " << options.shard_index << "/" << options.num_shards
+              << " written to " << checkpoint_file << std::endl;
+    return;
+  }
+
+  if (options.compare) {
+    ComputeOptions reference_options;
+    aligned_vector<float> reference(num_pixels);
+    compute_grid(reference.data(), alphas, betas, x_start, y_start,
+                 num_iterations, threshold, reference_options);
+    compare_grids(result, reference.data(), num_pixels, threshold,
+                  "float kernel (std::sin)");
+  }
+
+  if (options.adaptive_verify) {
+    ComputeOptions reference_options = options;
+    reference_options.adaptive = false;
+    aligned_vector<float> reference(num_pixels);
+    auto reference_start = std::chrono::system_clock::now();
+    compute_grid(reference.data(), alphas, betas, x_start, y_start,
+                 num_iterations, threshold, reference_options);
+    float reference_seconds = std::chrono::duration<float>(
+        std::chrono::system_clock::now() - reference_start).count();
+    compare_grids(result, reference.data(), num_pixels, threshold,
+                  "full computation (no adaptive subdivision)");
+    std::cout << "  time: " << compute_seconds << " adaptive, "
+              << reference_seconds << " full ("
+              << reference_seconds / compute_seconds << "x)" << std::endl;
+  }
+
+  RenderResult render_result{grid,    options, alphas, betas,
+                             x_start, y_start, result};
   time_start = std::chrono::system_clock::now();
-  write_png("picture.png", result.data(), threshold, alpha_num_params,
-            beta_num_params);
+  ImageSink(mapped_result.get()).consume(render_result);
   time_end = std::chrono::system_clock::now();
   elapsed_seconds = std::chrono::duration<float>(time_end - time_start).count();
   std::cout << "TIME for picture: " << elapsed_seconds << std::endl;
 
   // Generate output
+  if (!options.raw_output.empty()) {
+    time_start = std::chrono::system_clock::now();
+    if (mapped_result) {
+      mapped_result->sync();
+    } else {
+      RawSink(options.raw_output).consume(render_result);
+    }
+    time_end = std::chrono::system_clock::now();
+    elapsed_seconds =
+        std::chrono::duration<float>(time_end - time_start).count();
+    std::cout << "TIME for raw: " << elapsed_seconds << std::endl;
+  }
+
   if (output_csv) {
     time_start = std::chrono::system_clock::now();
     // Output result into .csv
-    std::string file_result = "result.csv";
-    std::ofstream ostrm_csv(file_result);
-    ostrm_csv << "alpha beta value\n";
-    for (int b = beta_num_params - 1; b >= 0; b--) {
-      for (int a = 0; a < alpha_num_params; a++) {
-        ostrm_csv << alphas[a] << ' ' << betas[b] << ' '
-                  << result[(beta_num_params - b - 1) * alpha_num_params + a]
-                  << '\n';
-      }
-    }
+    CsvSink csv(
+        options.text_format.separator == '\t' ? "result.tsv" : "result.csv",
+        options.text_format);
+    csv.consume(render_result);
+    std::size_t bytes = csv.bytes();
+    time_end = std::chrono::system_clock::now();
+    elapsed_seconds =
+        std::chrono::duration<float>(time_end - time_start).count();
+    std::cout << "TIME for csv: " << elapsed_seconds << " ("
+              << bytes / 1e6 / elapsed_seconds << " MB/s)" << std::endl;
+  }
+}
+
+void recolor_result(const std::string& filename, bool output_csv,
+                    const ComputeOptions& options) {
+  auto time_start = std::chrono::system_clock::now();
+  // memory mapped, the sinks read the values straight from the file
+  RawResult raw(filename);
+  ParameterGrid grid;
+  static_cast<GridParameters&>(grid) = parse_parameters(raw.parameters());
+  if (grid.width() != raw.width() || grid.height() != raw.height()) {
+    throw std::runtime_error(filename +
+                             ": grid size does not match the parameters");
+  }
+  if (options.png.clip_max == 0 &&
+      !(grid.threshold > options.png.clip_min)) {
+    throw std::runtime_error("the clipping minimum must be below the"
+                             " threshold " + std::to_string(grid.threshold) +
+                             " of " + filename);
+  }
+  aligned_vector<float> alphas = parameter_values(
+      grid.alphamin, grid.alphamax, grid.alpha_num_intervals);
+  aligned_vector<float> betas =
+      parameter_values(grid.betamin, grid.betamax, grid.beta_num_intervals);
+  aligned_vector<float> no_seeds;  // only needed for RenderResult::parameters
+  RenderResult render_result{grid,     options,  alphas,    betas,
+                             no_seeds, no_seeds, raw.data()};
+
+  ImageSink().consume(render_result);
+  auto time_end = std::chrono::system_clock::now();
+  float elapsed_seconds =
+      std::chrono::duration<float>(time_end - time_start).count();
+  std::cout << "TIME for picture: " << elapsed_seconds << " ("
+            << raw.size() / 1e6 / elapsed_seconds << " Mpixels/s)"
+            << std::endl;
+
+  if (output_csv) {
+    time_start = std::chrono::system_clock::now();
+    CsvSink csv(
+        options.text_format.separator == '\t' ? "result.tsv" : "result.csv",
+        options.text_format);
+    csv.consume(render_result);
+    std::size_t bytes = csv.bytes();
     time_end = std::chrono::system_clock::now();
     elapsed_seconds =
         std::chrono::duration<float>(time_end - time_start).count();
-    std::cout << "TIME for csv: " << elapsed_seconds << std::endl;
+    std::cout << "TIME for csv: " << elapsed_seconds << " ("
+              << bytes / 1e6 / elapsed_seconds << " MB/s)" << std::endl;
   }
 }
@@ -1,22 +1,334 @@
 #ifndef COMPUTE_H
 #define COMPUTE_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <boost/align/aligned_allocator.hpp>
 
+#include "fastmath.hpp"
+#include "picture.hpp"
+#include "scheduler.hpp"
+#include "textexport.hpp"
+
+// number of allocations done through aligned_allocator so far (all threads)
+std::size_t aligned_allocations();
+void count_aligned_allocation();
+
+// 64 byte aligned allocator which counts its allocations, so that the hot
+// loop can be checked to be allocation free
 template <typename T>
-using aligned_allocator = boost::alignment::aligned_allocator<T, 64>;
+class aligned_allocator : public boost::alignment::aligned_allocator<T, 64> {
+  typedef boost::alignment::aligned_allocator<T, 64> base;
+
+ public:
+  template <typename U>
+  struct rebind {
+    typedef aligned_allocator<U> other;
+  };
+
+  aligned_allocator() = default;
+  template <typename U>
+  aligned_allocator(const aligned_allocator<U>&) noexcept {}
+
+  T* allocate(std::size_t size) {
+    count_aligned_allocation();
+    return base::allocate(size);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const aligned_allocator<T>&, const aligned_allocator<U>&) {
+  return true;
+}
+template <typename T, typename U>
+bool operator!=(const aligned_allocator<T>&, const aligned_allocator<U>&) {
+  return false;
+}
+
 template <typename T>
 using aligned_vector = std::vector<T, aligned_allocator<T>>;
 
+// number of pixels packed into the SIMD lanes of the pixel kernel
+constexpr int LANES = 16;
+
+// kernel used for the per-pixel iteration:
+//   seeds:  one pixel at a time, vectorized over the seed array
+//   pixels: LANES neighbouring pixels of a row at a time, vectorized over the
+//           pixels, every lane retires and is refilled independently. Only
+//           faster than seeds with a polynomial sin2pi, std::sin does not
+//           vectorize over the lanes.
+//   fixed:  like seeds, but with 32 bit fixed point phases and a table
+//           driven sine instead of float math
+enum class Kernel { seeds, pixels, fixed };
+
+// distribution of the grid onto the threads:
+//   rows:  OpenMP dynamic schedule over the rows, serial without OpenMP
+//   tiles: square tiles, expensive ones first, work stealing std::threads
+enum class Schedule { rows, tiles };
+
+// optional settings of compute_all, defaults reproduce the original behaviour
+struct ComputeOptions {
+  Kernel kernel = Kernel::seeds;
+  SinAccuracy sin_accuracy = SinAccuracy::exact;
+  Schedule schedule = Schedule::tiles;
+  int tile_size = 64;
+  int num_threads = 0;  // 0: default_num_threads()
+  // Mariani-Silver subdivision of the tiles: interiors of blocks with a
+  // uniform border are filled instead of computed. Always uses the tile
+  // schedule. A border is uniform if all its pixels escaped, or, only with
+  // a tolerance >= 0, if all are bounded with values within the tolerance.
+  // The filled values are interpolated from the border, so filled bounded
+  // values are approximations (the parameters of saved results record the
+  // mode).
+  bool adaptive = false;
+  float adaptive_tolerance = -1.0f;  // negative: bounded blocks are computed
+  // additionally compute the grid without adaptive subdivision and report
+  // the differences and the time saved
+  bool adaptive_verify = false;
+  // detect periodic seed orbits and retire pixels whose orbits are all
+  // periodic early (seeds kernel only). Epsilon is the tolerance of the
+  // state comparison, 0 is exact: equal y and x up to an integer. Retired
+  // pixels keep the orbit state of their retirement, so a run with
+  // periodicity can not save states for deepen_grid.
+  bool periodicity = false;
+  float periodicity_epsilon = 1e-6f;
+  // file to record finished tiles in (none if empty), it is flushed at most
+  // every checkpoint_interval seconds. With resume the tiles recorded by an
+  // earlier run with the same parameters are not computed again. Always
+  // uses the tile schedule.
+  std::string checkpoint;
+  double checkpoint_interval = 60.0;
+  bool resume = false;
+  // file to save the final orbit states of the bounded pixels to (none if
+  // empty), and file of an earlier run with fewer iterations whose bounded
+  // pixels are continued instead of computing the grid (seeds kernel only)
+  std::string save_state;
+  std::string deepen;
+  // compute only the tiles of shard shard_index of num_shards into a
+  // checkpoint file (shard_<i>_of_<N>.ckpt unless checkpoint is set),
+  // always uses the tile schedule
+  int shard_index = 0;
+  int num_shards = 1;
+  // binary result file to write (none if empty), see rawresult.hpp
+  std::string raw_output;
+  // directory of earlier results to reuse (none if empty), limited to
+  // cache_max_bytes, see gridcache.hpp. Only used for in-memory runs without
+  // checkpoint, shard, orbit states or instrumentation.
+  std::string cache_dir;
+  std::uint64_t cache_max_bytes = std::uint64_t(4) << 30;
+  // compute into the memory mapped raw_output file instead of memory and
+  // stream the outputs from it, for grids larger than the memory
+  bool out_of_core = false;
+  // compute the rows in order and write the images while computing, the
+  // result is not kept, so there is no other output
+  bool stream = false;
+  // rows computed ahead of the last written row in stream mode, 0 for four
+  // per thread
+  int stream_window = 0;
+  // image outputs, none if empty: colored PNG, 16bit gray PNG and PFM of
+  // the raw values
+  std::string png_output = "picture.png";
+  std::string gray16_output;
+  std::string pfm_output;
+  // colors and compression of the PNGs
+  PngOptions png;
+  // JSON report and cost heatmap PNG of an instrumented build, none if
+  // empty, see instrumentation.hpp
+  std::string report;
+  std::string cost_map;
+  // layout of the text output, a tab separator writes result.tsv instead of
+  // result.csv
+  TextFormat text_format;
+  // additionally compute the grid with the float seed kernel and std::sin
+  // and report the differences
+  bool compare = false;
+};
+
+// caller-owned working memory of the kernels, one instance per thread. The
+// buffers only grow, so reusing a Scratch over many pixels does not allocate.
+struct Scratch {
+  aligned_vector<float> x;
+  aligned_vector<float> y;
+  aligned_vector<std::uint32_t> phase_x;  // fixed point kernel only
+  aligned_vector<std::int64_t> fixed_y;   // fixed point kernel only
+  // cycle detection only
+  aligned_vector<float> saved_x;
+  aligned_vector<float> saved_y;
+  std::size_t periodic_pixels = 0;  // pixels retired as periodic
+  std::size_t periodic_seeds = 0;   // seed orbits detected as periodic
+  // final orbit states of the bounded pixels, recorded if record_state
+  bool record_state = false;
+  std::vector<std::uint64_t> state_pixels;
+  std::vector<float> state_x;
+  std::vector<float> state_y;
+  // instrumentation only: iterations executed for the last pixel (per pixel
+  // of the row for compute_row), and where compute_grid stores them
+  int iterations = 0;
+  std::vector<int> row_iterations;
+  std::uint32_t* pixel_iterations = nullptr;
+};
+
+float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
+              const aligned_vector<float>& seed_y, int num_iterations,
+              float threshold, Scratch& scratch,
+              SinAccuracy accuracy = SinAccuracy::exact);
 float compute(float alpha, float beta, const aligned_vector<float>& seed_x,
               const aligned_vector<float>& seed_y, int num_iterations,
               float threshold);
 
+// computes the values of num_alphas pixels with the same beta into result
+void compute_row(const float* alphas, int num_alphas, float beta,
+                 const aligned_vector<float>& seed_x,
+                 const aligned_vector<float>& seed_y, int num_iterations,
+                 float threshold, float* result, Scratch& scratch,
+                 SinAccuracy accuracy = SinAccuracy::exact);
+
+// same as compute, but stops early when all seed orbits are periodic within
+// epsilon, the counters of the scratch are incremented accordingly
+float compute_periodic(float alpha, float beta,
+                       const aligned_vector<float>& seed_x,
+                       const aligned_vector<float>& seed_y, int num_iterations,
+                       float threshold, float epsilon, Scratch& scratch,
+                       SinAccuracy accuracy = SinAccuracy::exact);
+
+// continues the iteration of num_seeds orbits at x, y for num_iterations
+// more steps, d is the maximum |y| reached so far. The final state is left
+// in scratch.x and scratch.y.
+float compute_continue(float alpha, float beta, const float* x,
+                       const float* y, int num_seeds, float d,
+                       int num_iterations, float threshold, Scratch& scratch,
+                       SinAccuracy accuracy = SinAccuracy::exact);
+
+// same as compute, but iterates on fixed point phases with a table driven
+// sine (see Kernel::fixed)
+float compute_fixed(float alpha, float beta,
+                    const aligned_vector<float>& seed_x,
+                    const aligned_vector<float>& seed_y, int num_iterations,
+                    float threshold, Scratch& scratch);
+
+struct GridStats {
+  std::vector<ThreadStats> threads;  // empty for Schedule::rows
+  std::size_t filled_pixels = 0;     // pixels filled by adaptive subdivision
+  std::size_t periodic_pixels = 0;   // pixels retired by cycle detection
+  std::size_t periodic_seeds = 0;
+  bool cancelled = false;  // stopped by GridWorkspace::cancel, the result is
+                           // incomplete
+
+  void add_counters(const Scratch& scratch) {
+    periodic_pixels += scratch.periodic_pixels;
+    periodic_seeds += scratch.periodic_seeds;
+  }
+};
+
+// threads and scratch memory of compute_grid kept alive between calls
+struct GridWorkspace {
+  std::unique_ptr<TilePool> pool;  // tile schedule, replaced if the number
+                                   // of threads changes
+  std::vector<Scratch> scratches;  // one per thread
+  Scratch probe;                   // cost estimate of the tiles
+  // set by another thread to stop the computation, the rows resp. tiles not
+  // started yet are skipped
+  const std::atomic<bool>* cancel = nullptr;
+};
+
+class Checkpoint;
+struct OrbitState;
+struct Instrumentation;
+
+// computes all pixels of the grid given by alphas x betas into result, rows
+// are stored from the largest beta to the smallest. Tiles finished in the
+// checkpoint are skipped, newly finished ones are saved to it. The final
+// orbits of bounded pixels are appended to orbit_state if given. An
+// instrumented build records the costs into instrumentation if given. The
+// threads and scratches of workspace are used if given, otherwise they only
+// live for the call.
+GridStats compute_grid(float* result, const aligned_vector<float>& alphas,
+                       const aligned_vector<float>& betas,
+                       const aligned_vector<float>& seed_x,
+                       const aligned_vector<float>& seed_y, int num_iterations,
+                       float threshold, const ComputeOptions& options,
+                       Checkpoint* checkpoint = nullptr,
+                       OrbitState* orbit_state = nullptr,
+                       Instrumentation* instrumentation = nullptr,
+                       GridWorkspace* workspace = nullptr);
+
+// computes the rows of the grid in the order of compute_grid and passes each
+// of them to sink as soon as all rows before it are done. Rows are taken in
+// order by num_threads workers, which are at most options.stream_window rows
+// ahead of the sink, so memory stays O(width * window). The sink is called
+// from the worker threads, one call at a time, and may throw.
+GridStats stream_grid(const aligned_vector<float>& alphas,
+                      const aligned_vector<float>& betas,
+                      const aligned_vector<float>& seed_x,
+                      const aligned_vector<float>& seed_y, int num_iterations,
+                      float threshold, const ComputeOptions& options,
+                      const std::function<void(const float*)>& sink,
+                      GridWorkspace* workspace = nullptr);
+
+// like compute_grid, but starts from the result and orbit states of an
+// earlier run with state.iterations <= num_iterations
+GridStats deepen_grid(float* result, const aligned_vector<float>& alphas,
+                      const aligned_vector<float>& betas,
+                      const OrbitState& state, int num_iterations,
+                      float threshold, const ComputeOptions& options,
+                      OrbitState* orbit_state = nullptr,
+                      GridWorkspace* workspace = nullptr);
+
+// text description of everything that determines the result of a run,
+// used to check that stored results belong to the same parameters
+std::string describe_parameters(int num_iterations, float threshold,
+                                float alphamin, float alphamax,
+                                int alpha_num_intervals, float betamin,
+                                float betamax, int beta_num_intervals,
+                                const aligned_vector<float>& seed_x,
+                                const aligned_vector<float>& seed_y,
+                                const ComputeOptions& options);
+
+// maximum absolute error of sin2pi against std::sin over sampled periods
+float sin2pi_max_error(SinAccuracy accuracy);
+
+// the grid part of a describe_parameters() text
+struct GridParameters {
+  int num_iterations = 0;
+  float threshold = 0;
+  float alphamin = 0;
+  float alphamax = 0;
+  int alpha_num_intervals = 0;
+  float betamin = 0;
+  float betamax = 0;
+  int beta_num_intervals = 0;
+};
+
+// throws std::runtime_error if the description is incomplete
+GridParameters parse_parameters(const std::string& parameters);
+
+// num_intervals + 1 equidistant values from min to max
+aligned_vector<float> parameter_values(float min, float max,
+                                       int num_intervals);
+
+// seed points of compute_all: num_seedpoints - seedpoints.size() points
+// spaced uniformly in (0, 1/2) followed by the given ones, all with y = 0
+void make_seed_points(int num_seedpoints, const std::vector<float>& seedpoints,
+                      aligned_vector<float>& seed_x,
+                      aligned_vector<float>& seed_y);
+
 void compute_all(int num_iterations, float threshold, float alphamin,
                  float alphamax, int alpha_num_intervals, float betamin,
                  float betamax, int beta_num_intervals, int num_seedpoints,
-                 bool output_csv, std::vector<float> seedpoints);
+                 bool output_csv, std::vector<float> seedpoints,
+                 const ComputeOptions& options = ComputeOptions());
+
+// writes the images of options and result.csv (if output_csv) of a result
+// file saved before, e.g. with other colors, without computing anything.
+// The raw_output and the compute options are ignored. Throws
+// std::runtime_error on errors.
+void recolor_result(const std::string& filename, bool output_csv,
+                    const ComputeOptions& options);
 
 #endif  // COMPUTE_H
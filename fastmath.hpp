@@ -0,0 +1,71 @@
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include <cmath>
+
+constexpr float PI = 3.14159265358979323846264338327950288419716939f;
+constexpr float TWO_PI = 2 * PI;
+
+// accuracy tiers of sin2pi, maximum absolute error over the whole period:
+//   exact:  std::sin(TWO_PI * x), the original kernel
+//   low:    7e-5, degree 5 polynomial
+//   medium: 8e-7, degree 7 polynomial
+//   high:   2e-7 (float precision), degree 9 polynomial
+enum class SinAccuracy { exact, low, medium, high };
+
+// rounding to the nearest integer for |x| < 2^22 by adding and subtracting
+// 1.5 * 2^23, unlike std::nearbyint this vectorizes without SSE4.1. Relies on
+// value-safe floating point math, i.e. no -ffast-math.
+inline float round_nearest(float x) {
+  const float magic = 12582912.0f;
+  return (x + magic) - magic;
+}
+
+// x reduced to [-1/2, 1/2] modulo 1, exact for |x| < 2^22
+inline float reduce_period(float x) { return x - round_nearest(x); }
+
+namespace detail {
+// odd minimax polynomials p(r) ~ sin(2 pi r) for r in [-1/4, 1/4]
+template <SinAccuracy A>
+float sin2pi_poly(float r, float r2);
+
+template <>
+inline float sin2pi_poly<SinAccuracy::low>(float r, float r2) {
+  return r * (6.281280041e+00f +
+              r2 * (-4.109524155e+01f + r2 * 7.358551788e+01f));
+}
+
+template <>
+inline float sin2pi_poly<SinAccuracy::medium>(float r, float r2) {
+  return r * (6.283164024e+00f +
+              r2 * (-4.133714294e+01f +
+                    r2 * (8.134076691e+01f + r2 * -7.099343872e+01f)));
+}
+
+template <>
+inline float sin2pi_poly<SinAccuracy::high>(float r, float r2) {
+  return r * (6.283185005e+00f +
+              r2 * (-4.134165573e+01f +
+                    r2 * (8.160100555e+01f +
+                          r2 * (-7.654978180e+01f + r2 * 3.953671646e+01f))));
+}
+}  // namespace detail
+
+// sin(2 pi x) for |x| < 2^21, branch free so that it vectorizes. The argument
+// is reduced exactly to half periods, 2 x = q + r with integer q and
+// r in [-1/2, 1/2], and sin(2 pi x) = (-1)^q sin(pi r).
+template <SinAccuracy A>
+inline float sin2pi(float x) {
+  float h = 2.0f * x;
+  float q = round_nearest(h);
+  float r = 0.5f * (h - q);
+  float odd = std::abs(0.5f * q - round_nearest(0.5f * q));  // 0 or 1/2
+  return (1.0f - 4.0f * odd) * detail::sin2pi_poly<A>(r, r * r);
+}
+
+template <>
+inline float sin2pi<SinAccuracy::exact>(float x) {
+  return std::sin(TWO_PI * x);
+}
+
+#endif  // FASTMATH_H
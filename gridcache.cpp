@@ -0,0 +1,140 @@
+#include "gridcache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "rawresult.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// temporary files older than this were left behind by a run that died
+// while storing, younger ones may still be written by another run
+constexpr std::chrono::hours STALE_TEMPORARY_AGE(1);
+
+// 64 bit FNV-1a, the parameters stored in the file are compared on load, so
+// a collision only costs a recomputation
+std::uint64_t fnv1a(const std::string& text) {
+  std::uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+}  // namespace
+
+GridCache::GridCache(const std::string& directory, std::uint64_t max_bytes)
+    : directory_(directory), max_bytes_(max_bytes) {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+  if (error) {
+    throw std::runtime_error("can not create cache directory " + directory_ +
+                             ": " + error.message());
+  }
+}
+
+std::string GridCache::filename(const std::string& parameters) const {
+  std::ostringstream name;
+  name << std::hex << std::setw(16) << std::setfill('0') << fnv1a(parameters)
+       << ".raw";
+  return (fs::path(directory_) / name.str()).string();
+}
+
+bool GridCache::load(const std::string& parameters, float* result, int width,
+                     int height) const {
+  std::string file = filename(parameters);
+  std::error_code error;
+  if (!fs::exists(file, error)) return false;
+  try {
+    RawResult cached(file);
+    if (cached.parameters() != parameters || cached.width() != width ||
+        cached.height() != height) {
+      return false;
+    }
+    std::memcpy(result, cached.data(), cached.size() * sizeof(float));
+  } catch (std::runtime_error&) {
+    return false;  // damaged, replaced by the next store
+  }
+  // the modification time orders the files for the eviction
+  fs::last_write_time(file, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+void GridCache::store(const std::string& parameters, const float* result,
+                      int width, int height) const {
+  // written under a temporary name first, so that a concurrent or aborted
+  // run never sees half a file
+  std::string file = filename(parameters);
+#ifdef _WIN32
+  int pid = _getpid();
+#else
+  int pid = getpid();
+#endif
+  std::string temporary = file + "." + std::to_string(pid) + ".tmp";
+  std::error_code error;
+  try {
+    write_raw(temporary, parameters, result, width, height);
+  } catch (std::runtime_error&) {
+    fs::remove(temporary, error);
+    throw;
+  }
+  fs::rename(temporary, file, error);
+  if (error) {
+    fs::remove(temporary, error);
+    throw std::runtime_error("can not store " + file + " in the cache");
+  }
+
+  struct Entry {
+    fs::path path;
+    std::uint64_t size;
+    fs::file_time_type time;
+  };
+  std::vector<Entry> entries;
+  std::uint64_t total = 0;
+  const fs::file_time_type now = fs::file_time_type::clock::now();
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(directory_, error)) {
+    bool is_temporary = entry.path().extension() == ".tmp";
+    if (!is_temporary && entry.path().extension() != ".raw") continue;
+    std::error_code entry_error;
+    Entry e{entry.path(), entry.file_size(entry_error),
+            entry.last_write_time(entry_error)};
+    if (entry_error) continue;
+    if (is_temporary) {
+      // stale ones are removed, the others take space until renamed
+      std::error_code remove_error;
+      if (now - e.time > STALE_TEMPORARY_AGE &&
+          fs::remove(e.path, remove_error)) {
+        continue;
+      }
+      total += e.size;
+      continue;
+    }
+    entries.push_back(e);
+    total += e.size;
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.time < b.time; });
+  // oldest first, the new file is kept even if it alone exceeds the limit
+  for (const Entry& entry : entries) {
+    if (total <= max_bytes_) break;
+    if (entry.path == fs::path(file)) continue;
+    if (fs::remove(entry.path, error)) total -= entry.size;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef GRIDCACHE_H
+#define GRIDCACHE_H
+
+#include <cstdint>
+#include <string>
+
+// Results of earlier runs in a directory, stored as result files (see
+// rawresult.hpp) named after a hash of their describe_parameters() text, so
+// that a run with the same parameters, seeds and kernel settings does not
+// compute again. The least recently used files are removed once the
+// directory grows beyond max_bytes.
+class GridCache {
+ public:
+  // creates the directory if needed, throws std::runtime_error on errors
+  GridCache(const std::string& directory, std::uint64_t max_bytes);
+
+  // file of the result of parameters in the cache, whether it exists or not
+  std::string filename(const std::string& parameters) const;
+
+  // copies the cached result of parameters into result and returns true if
+  // there is one of the given size
+  bool load(const std::string& parameters, float* result, int width,
+            int height) const;
+
+  // adds the result and removes the least recently used ones beyond the
+  // size limit, throws std::runtime_error on errors
+  void store(const std::string& parameters, const float* result, int width,
+             int height) const;
+
+ private:
+  std::string directory_;
+  std::uint64_t max_bytes_;
+};
+
+#endif  // GRIDCACHE_H
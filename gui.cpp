@@ -1,17 +1,42 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <FL/Fl.H>
 #include <FL/Fl_Box.H>
-#include <FL/Fl_PNG_Image.H>
+#include <FL/Fl_RGB_Image.H>
 #include <FL/Fl_Scroll.H>
 #include <FL/Fl_Window.H>
 
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Check_Button.H>
+#include <FL/Fl_Choice.H>
 #include <FL/Fl_Value_Input.H>
 
-#include "compute.hpp"
+#include "tilecache.hpp"
+
+class SimpleWindow;
+
+// the picture, dragging it pans the view, the mouse wheel zooms
+class PlaneBox : public Fl_Box {
+ public:
+  explicit PlaneBox(SimpleWindow* window) : Fl_Box(0, 0, 0, 0), window(window) {}
+  int handle(int event) override;
+
+ private:
+  SimpleWindow* window;
+  int last_x = 0;
+  int last_y = 0;
+};
 
 class SimpleWindow : public Fl_Window {
  public:
@@ -19,13 +44,15 @@ class SimpleWindow : public Fl_Window {
   ~SimpleWindow();
 
   Fl_Scroll* scroll;
-  Fl_Box* imagebox;
+  PlaneBox* imagebox;
 
   Fl_Group* group;
 
-  Fl_PNG_Image* image;
+  Fl_RGB_Image* image = nullptr;  // shows pixels
 
   Fl_Button* button_compute;
+  Fl_Button* button_cancel;
+  Fl_Box* status;
 
   Fl_Value_Input* in_num_iterations;
   Fl_Value_Input* in_threshold;
@@ -38,14 +65,130 @@ class SimpleWindow : public Fl_Window {
   Fl_Value_Input* in_num_seedpoints;
   Fl_Value_Input* in_special_seedpoint;
   Fl_Check_Button* in_output_csv;
+  Fl_Choice* in_colormap;
+
+  // moves the view by dx, dy pixels resp. zooms in (levels > 0) or out
+  // around pixel x, y
+  void pan(int dx, int dy);
+  void zoom(int levels, int x, int y);
 
  private:
+  // a computation for the worker thread
+  struct Request {
+    PlaneView view;
+    int num_iterations;
+    float threshold;
+    int num_seedpoints;
+    float special_seedpoint;
+    ComputeOptions options;
+    bool output_csv;
+    bool progressive;  // show coarse previews first
+    long generation;
+    std::shared_ptr<std::atomic<bool>> cancel;
+  };
+
+  // computes the requests one after the other, each first as a coarse
+  // preview which is refined up to the full resolution
+  void worker_loop();
+  // hands a picture of the worker to the event thread: rgb of view coarsened
+  // by factor, shown at the size of the full one
+  void publish(long generation, const std::vector<unsigned char>& rgb,
+               const PlaneView& view, int factor, const std::string& text);
+
+  void start_computation();
+  void cancel_computation();
+  void request_view(bool progressive);
+  void show_view();  // writes the range of view to the inputs
+
+  // the shown part of the parameter plane, event thread only
+  PlaneView view;
+
+  // everything below is shared with the worker and guarded by mutex
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::unique_ptr<Request> request;  // next one for the worker
+  std::shared_ptr<std::atomic<bool>> cancel;  // of the latest request
+  long generation = 0;                        // of the latest request
+  bool quit = false;
+  // latest picture of the worker, swapped into pixels when shown
+  std::vector<unsigned char> frame;
+  int frame_width = 0;
+  int frame_height = 0;
+  long frame_generation = -1;
+  std::string frame_text;
+
+  std::vector<unsigned char> pixels;  // event thread only
+  std::thread worker;
+
   static void callback_compute(Fl_Widget*, void*);
+  static void callback_cancel(Fl_Widget*, void*);
+  static void callback_frame(void*);
   inline void callback_compute_il();
+  inline void callback_frame_il();
 };
 
+namespace {
+
+// computed tiles are kept up to this size, so that panning and zooming back
+// does not compute them again
+constexpr std::size_t TILE_CACHE_BYTES = std::size_t(256) << 20;
+
+// coarsening factors of the previews of a width x height picture, powers of
+// two from the first one giving at most 64 x 64 pixels down to 1
+std::vector<int> preview_steps(int width, int height) {
+  int step = 1;
+  while (std::max(width, height) / step > 64) step *= 2;
+  std::vector<int> steps;
+  for (; step >= 1; step /= 2) steps.push_back(step);
+  return steps;
+}
+
+// the pixels of view from the RGB picture of view.coarser(factor)
+void scale_rgb(const unsigned char* rgb, const PlaneView& view, int factor,
+               std::vector<unsigned char>& scaled) {
+  PlaneView coarse = view.coarser(factor);
+  scaled.resize(3 * static_cast<std::size_t>(view.width) * view.height);
+  for (int y = 0; y < view.height; y++) {
+    long long source_y = coarse.y0 - floor_div(view.y0 - y, factor);
+    for (int x = 0; x < view.width; x++) {
+      long long source_x = floor_div(view.x0 + x, factor) - coarse.x0;
+      std::copy_n(rgb + 3 * (source_y * coarse.width + source_x), 3,
+                  scaled.begin() +
+                      3 * (static_cast<std::size_t>(y) * view.width + x));
+    }
+  }
+}
+
+}  // namespace
+
+int PlaneBox::handle(int event) {
+  switch (event) {
+    case FL_PUSH:
+      last_x = Fl::event_x();
+      last_y = Fl::event_y();
+      return 1;  // to get the drags
+    case FL_DRAG:
+      if (Fl::event_x() != last_x || Fl::event_y() != last_y) {
+        window->pan(Fl::event_x() - last_x, Fl::event_y() - last_y);
+        last_x = Fl::event_x();
+        last_y = Fl::event_y();
+      }
+      return 1;
+    case FL_RELEASE:
+      return 1;
+    case FL_MOUSEWHEEL:
+      if (Fl::event_dy() != 0) {
+        window->zoom(Fl::event_dy() < 0 ? 1 : -1, Fl::event_x() - x(),
+                     Fl::event_y() - y());
+      }
+      return 1;
+  }
+  return Fl_Box::handle(event);
+}
+
 int main() {
-  SimpleWindow win(600, 500, "Dynamic Systems");
+  Fl::lock();  // enables Fl::awake from the worker thread
+  SimpleWindow win(600, 540, "Dynamic Systems");
   return Fl::run();
 }
 
@@ -55,16 +198,14 @@ SimpleWindow::SimpleWindow(int w, int h, const char* title)
   // between begin...end comes what to show in window
   this->begin();  // this-> is implicit
 
-  // Top: scrolling box containing the picture
-  image = new Fl_PNG_Image("picture.png");
-
+  // Top: scrolling box containing the picture, empty until the first
+  // computation
   int scrollheight = 400;
   int scrollwidth = 600;
   scroll = new Fl_Scroll(0, 0, 600, 400);
 
   scroll->begin();
-  imagebox = new Fl_Box(0, 0, image->w(), image->h());
-  imagebox->image(image);
+  imagebox = new PlaneBox(this);
   scroll->end();
 
   // Bottom: inputboxes and button
@@ -73,9 +214,10 @@ SimpleWindow::SimpleWindow(int w, int h, const char* title)
   int boxheight = 20;  // height input boxes
   int firstrow = scrollheight + 1 * boxheight;
   int secondrow = firstrow + 2 * boxheight;
+  int thirdrow = secondrow + 2 * boxheight;
   int padding = 100;
 
-  group = new Fl_Group(0, scrollheight, 6 * padding, 100);
+  group = new Fl_Group(0, scrollheight, 6 * padding, 140);
   group->begin();
   in_alphamin = new Fl_Value_Input(0 * padding, firstrow, boxwidth, boxheight,
                                    "alpha_min");
@@ -140,37 +282,252 @@ SimpleWindow::SimpleWindow(int w, int h, const char* title)
   in_output_csv = new Fl_Check_Button(5 * padding, secondrow, boxwidth,
                                       boxheight, "csv output");
 
+  button_cancel =
+      new Fl_Button(5 * padding, thirdrow, boxwidth, boxheight, "cancel");
+  button_cancel->type(FL_NORMAL_BUTTON);
+  button_cancel->callback(callback_cancel, this);
+
+  status = new Fl_Box(1 * padding, thirdrow, 4 * padding, boxheight);
+  status->align(FL_ALIGN_LEFT | FL_ALIGN_INSIDE);
+
+  // same order as enum class Colormap
+  in_colormap =
+      new Fl_Choice(0 * padding, thirdrow, boxwidth, boxheight, "colormap");
+  in_colormap->align(FL_ALIGN_TOP);
+  in_colormap->add("magma");
+  in_colormap->add("inferno");
+  in_colormap->add("plasma");
+  in_colormap->add("viridis");
+  in_colormap->value(static_cast<int>(Colormap::viridis));
+
+  // every change of a parameter replaces the running computation
+  std::vector<Fl_Widget*> inputs = {
+      in_alphamin, in_alphamax, in_alpha_num_intervals, in_num_iterations,
+      in_threshold, in_betamin, in_betamax, in_beta_num_intervals,
+      in_num_seedpoints, in_special_seedpoint, in_colormap};
+  for (Fl_Widget* input : inputs) input->callback(callback_compute, this);
+
   group->end();
 
   this->end();
   this->resizable(scroll);
   this->show();
+
+  worker = std::thread(&SimpleWindow::worker_loop, this);
+  start_computation();
 }
 
 // Destructor
-SimpleWindow::~SimpleWindow() {}
+SimpleWindow::~SimpleWindow() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+    if (cancel) cancel->store(true);
+  }
+  wake.notify_one();
+  worker.join();
+  delete image;
+}
 
 // Button callback, just cast object and call real function
 void SimpleWindow::callback_compute(Fl_Widget* o, void* v) {
   ((SimpleWindow*)v)->callback_compute_il();
 }
 
+void SimpleWindow::callback_cancel(Fl_Widget* o, void* v) {
+  ((SimpleWindow*)v)->cancel_computation();
+}
+
+// called on the event thread after publish
+void SimpleWindow::callback_frame(void* v) {
+  ((SimpleWindow*)v)->callback_frame_il();
+}
+
 // no arguments needed, because has access to all class members
-void SimpleWindow::callback_compute_il() {
-  std::cout << "start computation..." << std::endl;
+void SimpleWindow::callback_compute_il() { start_computation(); }
+
+// the view of the inputs, the spacing is kept if it did not change, so that
+// the computed tiles stay valid
+void SimpleWindow::start_computation() {
+  int width = in_alpha_num_intervals->value() + 1;
+  int height = in_beta_num_intervals->value() + 1;
+  double alphamin = in_alphamin->value(), alphamax = in_alphamax->value();
+  double betamin = in_betamin->value(), betamax = in_betamax->value();
+  if (width < 2 || height < 2 || alphamax <= alphamin || betamax <= betamin) {
+    status->copy_label("invalid range");
+    return;
+  }
+  double alpha_spacing = (alphamax - alphamin) / (width - 1);
+  double beta_spacing = (betamax - betamin) / (height - 1);
+  auto same = [](double a, double b) { return std::abs(a - b) <= 1e-9 * b; };
+  if (!same(alpha_spacing, view.alpha_spacing)) {
+    view.alpha_spacing = alpha_spacing;
+  }
+  if (!same(beta_spacing, view.beta_spacing)) {
+    view.beta_spacing = beta_spacing;
+  }
+  view.x0 = std::llround(alphamin / view.alpha_spacing);
+  view.y0 = std::llround(betamax / view.beta_spacing);
+  view.width = width;
+  view.height = height;
+  request_view(true);
+}
 
-  std::vector<float> seedpoints;
-  seedpoints.push_back(in_special_seedpoint->value());
+void SimpleWindow::pan(int dx, int dy) {
+  view.x0 -= dx;
+  view.y0 += dy;
+  show_view();
+  request_view(false);
+}
+
+void SimpleWindow::zoom(int levels, int x, int y) {
+  PlaneView zoomed = view.zoomed(levels, x, y);
+  // beyond the float resolution neighbouring pixels get the same parameters
+  if (zoomed.alpha_spacing < 1e-6 || zoomed.beta_spacing < 1e-6) return;
+  view = zoomed;
+  show_view();
+  request_view(true);
+}
 
-  compute_all(in_num_iterations->value(), in_threshold->value(),
-              in_alphamin->value(), in_alphamax->value(),
-              in_alpha_num_intervals->value(), in_betamin->value(),
-              in_betamax->value(), in_beta_num_intervals->value(),
-              in_num_seedpoints->value(), in_output_csv->value(), seedpoints);
+void SimpleWindow::show_view() {
+  in_alphamin->value(view.x0 * view.alpha_spacing);
+  in_alphamax->value((view.x0 + view.width - 1) * view.alpha_spacing);
+  in_betamin->value((view.y0 - view.height + 1) * view.beta_spacing);
+  in_betamax->value(view.y0 * view.beta_spacing);
+}
+
+void SimpleWindow::request_view(bool progressive) {
+  if (in_num_iterations->value() < 1 || in_num_seedpoints->value() < 1) {
+    status->copy_label("invalid parameters");
+    return;
+  }
+  std::unique_ptr<Request> next(new Request);
+  next->view = view;
+  next->num_iterations = in_num_iterations->value();
+  next->threshold = in_threshold->value();
+  next->num_seedpoints = in_num_seedpoints->value();
+  next->special_seedpoint = in_special_seedpoint->value();
+  next->options.png.colormap = static_cast<Colormap>(in_colormap->value());
+  next->output_csv = in_output_csv->value();
+  next->progressive = progressive;
+  next->cancel = std::make_shared<std::atomic<bool>>(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cancel) cancel->store(true);
+    cancel = next->cancel;
+    next->generation = ++generation;
+    request = std::move(next);
+  }
+  wake.notify_one();
+  status->copy_label("computing...");
+}
+
+void SimpleWindow::cancel_computation() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cancel) cancel->store(true);
+    request.reset();
+    ++generation;  // pictures still on the way are dropped
+  }
+  status->copy_label("cancelled");
+}
+
+void SimpleWindow::worker_loop() {
+  // kept between computations with its tiles, threads and scratch memory
+  PlaneRenderer renderer(TILE_CACHE_BYTES);
+  std::vector<float> values;
+  std::vector<unsigned char> rgb;
+  while (true) {
+    std::unique_ptr<Request> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return quit || request; });
+      if (quit) return;
+      job = std::move(request);
+    }
+    renderer.options() = job->options;
+    renderer.set_cancel(job->cancel.get());
+    aligned_vector<float> seed_x, seed_y;
+    make_seed_points(job->num_seedpoints, {job->special_seedpoint}, seed_x,
+                     seed_y);
+    const PlaneView& view = job->view;
+    std::vector<int> steps = {1};
+    if (job->progressive) steps = preview_steps(view.width, view.height);
+    auto time_start = std::chrono::steady_clock::now();
+    try {
+      for (int step : steps) {
+        PlaneView preview = view.coarser(step);
+        std::size_t num_pixels =
+            static_cast<std::size_t>(preview.width) * preview.height;
+        values.resize(num_pixels);
+        PlaneStats stats =
+            renderer.render(preview, job->num_iterations, job->threshold,
+                            seed_x, seed_y, values.data());
+        if (stats.cancelled) break;
+        rgb.resize(3 * num_pixels);
+        colorize(values.data(), num_pixels, job->threshold,
+                 job->options.png.colormap, rgb.data());
+        if (step == 1 && job->output_csv) {
+          aligned_vector<float> alphas(view.width), betas(view.height);
+          for (int x = 0; x < view.width; x++) {
+            alphas[x] = static_cast<float>((view.x0 + x) * view.alpha_spacing);
+          }
+          for (int y = 0; y < view.height; y++) {
+            betas[y] = static_cast<float>((view.y0 - view.height + 1 + y) *
+                                          view.beta_spacing);
+          }
+          write_csv("result.csv", values.data(), alphas.data(), view.width,
+                    betas.data(), view.height, job->options.text_format);
+        }
+
+        std::ostringstream text;
+        text << (step == 1 ? "done " : "preview ") << preview.width << "x"
+             << preview.height << " in "
+             << std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - time_start)
+                    .count()
+             << " s, tiles: " << stats.computed_tiles << " computed, "
+             << stats.cached_tiles + stats.assembled_tiles << " cached";
+        publish(job->generation, rgb, view, step, text.str());
+      }
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+}
+
+void SimpleWindow::publish(long job_generation,
+                           const std::vector<unsigned char>& rgb,
+                           const PlaneView& view, int factor,
+                           const std::string& text) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (job_generation != generation) return;  // replaced meanwhile
+    scale_rgb(rgb.data(), view, factor, frame);
+    frame_width = view.width;
+    frame_height = view.height;
+    frame_generation = job_generation;
+    frame_text = text;
+  }
+  Fl::awake(callback_frame, this);
+}
 
-  image = new Fl_PNG_Image("picture.png");
+void SimpleWindow::callback_frame_il() {
+  int width, height;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (frame_generation != generation) return;
+    // the image only points to the pixels, it is replaced right away
+    pixels.swap(frame);
+    width = frame_width;
+    height = frame_height;
+    frame_generation = -1;
+    status->copy_label(frame_text.c_str());
+  }
+  imagebox->image(nullptr);
+  delete image;
+  image = new Fl_RGB_Image(pixels.data(), width, height, 3);
   imagebox->image(image);
-  imagebox->resize(0, 0, image->w(), image->h());
-  redraw();
-  std::cout << "finished computation." << std::endl;
+  imagebox->resize(0, 0, width, height);
+  scroll->redraw();
 }
@@ -0,0 +1,92 @@
+#include "instrumentation.hpp"
+
+#include <fstream>
+#include <locale>
+#include <stdexcept>
+
+void write_report(const std::string& filename,
+                  const Instrumentation& instrumentation, const float* result,
+                  int width, int height, int num_iterations, float threshold,
+                  double seconds) {
+  const std::vector<std::uint32_t>& iterations =
+      instrumentation.pixel_iterations;
+  std::size_t num_pixels = static_cast<std::size_t>(width) * height;
+
+  // escape iterations in power of two buckets [2^k, 2^(k+1))
+  std::vector<std::size_t> escaped(33);
+  std::size_t bounded = 0;
+  std::size_t not_computed = 0;
+  std::uint64_t total_iterations = 0;
+  for (std::size_t i = 0; i < num_pixels; i++) {
+    std::uint32_t n = iterations[i];
+    total_iterations += n;
+    if (n == 0) {
+      not_computed++;
+    } else if (result[i] <= threshold) {
+      bounded++;
+    } else {
+      int bucket = 0;
+      while ((n >> (bucket + 1)) != 0) bucket++;
+      escaped[bucket]++;
+    }
+  }
+
+  std::ofstream out(filename);
+  out.imbue(std::locale::classic());
+  out << "{\n"
+      << "  \"width\": " << width << ",\n"
+      << "  \"height\": " << height << ",\n"
+      << "  \"iterations\": " << num_iterations << ",\n"
+      << "  \"threshold\": " << threshold << ",\n"
+      << "  \"seconds\": " << seconds << ",\n"
+      << "  \"pixel_iterations\": " << total_iterations << ",\n"
+      << "  \"mean_iterations_per_pixel\": "
+      << static_cast<double>(total_iterations) / num_pixels << ",\n"
+      << "  \"ns_per_pixel_iteration\": "
+      << (total_iterations > 0 ? seconds * 1e9 / total_iterations : 0)
+      << ",\n";
+
+  out << "  \"escape\": {\n"
+      << "    \"bounded\": " << bounded << ",\n"
+      << "    \"not_computed\": " << not_computed << ",\n"
+      << "    \"escaped\": [";
+  bool first = true;
+  for (std::size_t k = 0; k < escaped.size(); k++) {
+    if (escaped[k] == 0) continue;
+    out << (first ? "\n" : ",\n") << "      {\"from\": " << (1ull << k)
+        << ", \"to\": " << (2ull << k) << ", \"pixels\": " << escaped[k]
+        << "}";
+    first = false;
+  }
+  out << "\n    ]\n  },\n";
+
+  out << "  \"threads\": [";
+  for (std::size_t t = 0; t < instrumentation.threads.size(); t++) {
+    const ThreadStats& s = instrumentation.threads[t];
+    out << (t > 0 ? ",\n" : "\n") << "    {\"thread\": " << t
+        << ", \"busy_seconds\": " << s.busy_seconds
+        << ", \"idle_seconds\": " << s.idle_seconds
+        << ", \"tiles\": " << s.tiles << ", \"stolen\": " << s.stolen << "}";
+  }
+  out << "\n  ],\n";
+
+  out << "  \"tiles\": [";
+  for (std::size_t i = 0; i < instrumentation.tiles.size(); i++) {
+    const TileTiming& t = instrumentation.tiles[i];
+    out << (i > 0 ? ",\n" : "\n") << "    {\"x0\": " << t.tile.x0
+        << ", \"y0\": " << t.tile.y0 << ", \"width\": " << t.tile.width
+        << ", \"height\": " << t.tile.height << ", \"thread\": " << t.thread
+        << ", \"seconds\": " << t.seconds << "}";
+  }
+  out << "\n  ]\n}\n";
+  if (!out.flush()) throw std::runtime_error("error writing " + filename);
+}
+
+void write_cost_map(const std::string& filename,
+                    const Instrumentation& instrumentation, int width,
+                    int height, int num_iterations, const PngOptions& options) {
+  std::vector<float> cost(instrumentation.pixel_iterations.begin(),
+                          instrumentation.pixel_iterations.end());
+  write_png(filename.c_str(), cost.data(), static_cast<float>(num_iterations),
+            width, height, options);
+}
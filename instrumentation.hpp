@@ -0,0 +1,48 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "picture.hpp"
+#include "scheduler.hpp"
+
+// Statements in INSTRUMENT(...) are only compiled with the CMake option
+// DYNAMICSYSTEMS_INSTRUMENTATION, otherwise they cost nothing.
+#ifdef DYNAMICSYSTEMS_INSTRUMENTATION
+#define INSTRUMENT(...) __VA_ARGS__
+constexpr bool instrumentation_enabled = true;
+#else
+#define INSTRUMENT(...)
+constexpr bool instrumentation_enabled = false;
+#endif
+
+struct TileTiming {
+  Tile tile;  // a whole row for Schedule::rows
+  int thread;
+  double seconds;
+};
+
+// costs recorded by compute_grid in an instrumented build
+struct Instrumentation {
+  // iterations executed per pixel, 0 for pixels filled by --adaptive
+  std::vector<std::uint32_t> pixel_iterations;
+  std::vector<TileTiming> tiles;
+  std::vector<ThreadStats> threads;  // empty for Schedule::rows
+};
+
+// writes a JSON report of the run: totals, threads, tiles and the
+// distribution of the escape iterations. Throws std::runtime_error on errors.
+void write_report(const std::string& filename,
+                  const Instrumentation& instrumentation, const float* result,
+                  int width, int height, int num_iterations, float threshold,
+                  double seconds);
+
+// PNG of the iterations per pixel through write_png, pixels that ran all
+// num_iterations get the top color of the colormap
+void write_cost_map(const std::string& filename,
+                    const Instrumentation& instrumentation, int width,
+                    int height, int num_iterations, const PngOptions& options);
+
+#endif  // INSTRUMENTATION_H
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "checkpoint.hpp"
+#include "compute.hpp"
+#include "picture.hpp"
+#include "rawresult.hpp"
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> inputs;
+  std::string output_png;
+  std::string output_csv;
+  std::string output_raw;
+  std::string colormap;
+  PngOptions png;
+
+  namespace po = boost::program_options;
+  try {
+    po::options_description desc("Options");
+    desc.add_options()
+      ("help", "Help message")
+      ("input", po::value<std::vector<std::string>>(&inputs)->multitoken(),
+      " Shard files written by dynamicsystems-cli --shard")
+      ("png,o", po::value<std::string>(&output_png)->default_value(
+      "picture.png"), " Output picture")
+      ("csv,O", po::value<std::string>(&output_csv),
+      " Output csv file (none if not given)")
+      ("raw,R", po::value<std::string>(&output_raw),
+      " Output raw result file (none if not given)")
+      ("colormap", po::value<std::string>(&colormap)
+      ->default_value("viridis"),
+      " Colors of the picture: 'magma', 'inferno', 'plasma' or 'viridis'")
+      ("clip-min", po::value<float>(&png.clip_min)->default_value(0),
+      " Value taking the first color of the colormap, lower values as well")
+      ("clip-max", po::value<float>(&png.clip_max)->default_value(0),
+      " Value taking the last color of the colormap, higher values up to the"
+      " threshold as well, 0 for the threshold")
+      ("gamma", po::value<float>(&png.gamma)->default_value(1),
+      " Gamma of the colors, values above 1 spread the low values over more"
+      " colors")
+      ("invert", po::bool_switch(&png.invert),
+      " Reverse the colormap")
+      ;
+    po::positional_options_description positional;
+    positional.add("input", -1);
+
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv)
+                  .options(desc)
+                  .positional(positional)
+                  .run(),
+              vm);
+
+    if (vm.count("help") || !vm.count("input")) {
+      std::cout << "Usage: dynamicsystems-merge [options] shard files...\n"
+                << desc << std::endl;
+      return vm.count("help") ? 0 : -1;
+    }
+
+    po::notify(vm);
+
+    if (colormap == "magma") {
+      png.colormap = Colormap::magma;
+    } else if (colormap == "inferno") {
+      png.colormap = Colormap::inferno;
+    } else if (colormap == "plasma") {
+      png.colormap = Colormap::plasma;
+    } else if (colormap == "viridis") {
+      png.colormap = Colormap::viridis;
+    } else {
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "colormap", colormap);
+    }
+    // --clip-max 0 is checked against the threshold of the shards below
+    if (!(png.gamma > 0) ||
+        (png.clip_max != 0 && !(png.clip_max > png.clip_min))) {
+      throw po::error("--gamma must be positive and --clip-max (or the"
+                      " threshold) larger than --clip-min");
+    }
+  } catch (po::error& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+
+  try {
+    std::string parameters;
+    int width = 0;
+    int height = 0;
+    std::vector<float> result;
+    std::vector<char> covered;
+
+    for (const std::string& input : inputs) {
+      std::ifstream file(input, std::ios::binary);
+      if (!file) throw std::runtime_error("error opening file " + input);
+      std::string file_parameters;
+      int file_width, file_height;
+      read_checkpoint_header(file, input, file_parameters, file_width,
+                             file_height);
+      if (result.empty()) {
+        parameters = file_parameters;
+        width = file_width;
+        height = file_height;
+        result.resize(static_cast<std::size_t>(width) * height);
+        covered.resize(result.size());
+      } else if (file_parameters != parameters || file_width != width ||
+                 file_height != height) {
+        throw std::runtime_error(input + " was computed with different"
+                                 " parameters than " + inputs.front());
+      }
+      std::vector<Tile> tiles =
+          read_checkpoint_tiles(file, input, width, height, result.data());
+      for (const Tile& tile : tiles) {
+        for (int r = tile.y0; r < tile.y0 + tile.height; r++) {
+          std::size_t row = static_cast<std::size_t>(r) * width;
+          std::fill(covered.begin() + row + tile.x0,
+                    covered.begin() + row + tile.x0 + tile.width, 1);
+        }
+      }
+      std::cout << input << ": " << tiles.size() << " tiles" << std::endl;
+    }
+
+    std::size_t missing = std::count(covered.begin(), covered.end(), 0);
+    if (missing > 0) {
+      throw std::runtime_error(std::to_string(missing) + " of " +
+                               std::to_string(result.size()) +
+                               " pixels are missing, are all shards"
+                               " finished?");
+    }
+
+    GridParameters grid = parse_parameters(parameters);
+    if (grid.alpha_num_intervals + 1 != width ||
+        grid.beta_num_intervals + 1 != height) {
+      throw std::runtime_error("grid size does not match the parameters");
+    }
+    if (png.clip_max == 0 && !(grid.threshold > png.clip_min)) {
+      throw std::runtime_error("--clip-min must be below the threshold");
+    }
+    write_png(output_png.c_str(), result.data(), grid.threshold, width,
+              height, png);
+    if (!output_raw.empty()) {
+      // without the tile size the checkpoints record last, the result does
+      // not depend on it
+      write_raw(output_raw,
+                parameters.substr(0, parameters.rfind("checkpoint_tile_size ")),
+                result.data(), width, height);
+    }
+    if (!output_csv.empty()) {
+      aligned_vector<float> alphas = parameter_values(
+          grid.alphamin, grid.alphamax, grid.alpha_num_intervals);
+      aligned_vector<float> betas = parameter_values(
+          grid.betamin, grid.betamax, grid.beta_num_intervals);
+      write_csv(output_csv, result.data(), alphas.data(), width, betas.data(),
+                height);
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+}
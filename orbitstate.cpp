@@ -0,0 +1,134 @@
+#include "orbitstate.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+namespace {
+
+const char MAGIC[8] = {'D', 'S', 'S', 'T', 'A', 'T', 'E', '1'};
+
+template <typename T>
+void write_value(std::ostream& stream, const T& value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void write_array(std::ostream& stream, const std::vector<T>& values) {
+  stream.write(reinterpret_cast<const char*>(values.data()),
+               values.size() * sizeof(T));
+}
+
+template <typename T>
+bool read_value(std::istream& stream, T& value) {
+  return static_cast<bool>(
+      stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+template <typename T>
+bool read_array(std::istream& stream, std::vector<T>& values,
+                std::size_t size) {
+  values.resize(size);
+  return static_cast<bool>(stream.read(reinterpret_cast<char*>(values.data()),
+                                       size * sizeof(T)));
+}
+
+}  // namespace
+
+std::string parameters_without_iterations(const std::string& parameters) {
+  std::size_t end_of_line = parameters.find('\n');
+  return end_of_line == std::string::npos ? std::string()
+                                          : parameters.substr(end_of_line + 1);
+}
+
+void sort_pixels(OrbitState& state) {
+  if (std::is_sorted(state.pixels.begin(), state.pixels.end())) return;
+  std::size_t num_pixels = state.pixels.size();
+  std::size_t num_seeds = state.num_seeds;
+  std::vector<std::size_t> order(num_pixels);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return state.pixels[a] < state.pixels[b];
+  });
+  std::vector<std::uint64_t> pixels(num_pixels);
+  std::vector<float> x(num_pixels * num_seeds), y(num_pixels * num_seeds);
+  for (std::size_t i = 0; i < num_pixels; i++) {
+    pixels[i] = state.pixels[order[i]];
+    std::copy_n(state.x.begin() + order[i] * num_seeds, num_seeds,
+                x.begin() + i * num_seeds);
+    std::copy_n(state.y.begin() + order[i] * num_seeds, num_seeds,
+                y.begin() + i * num_seeds);
+  }
+  state.pixels.swap(pixels);
+  state.x.swap(x);
+  state.y.swap(y);
+}
+
+void write_orbit_state(const std::string& filename, const OrbitState& state) {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file) throw std::runtime_error("error opening file " + filename);
+  file.write(MAGIC, sizeof(MAGIC));
+  write_value<std::uint64_t>(file, state.parameters.size());
+  file.write(state.parameters.data(), state.parameters.size());
+  write_value<std::int32_t>(file, state.iterations);
+  write_value<std::int32_t>(file, state.width);
+  write_value<std::int32_t>(file, state.height);
+  write_value<std::int32_t>(file, state.num_seeds);
+  write_array(file, state.result);
+  write_value<std::uint64_t>(file, state.pixels.size());
+  write_array(file, state.pixels);
+  write_array(file, state.x);
+  write_array(file, state.y);
+  if (!file) throw std::runtime_error("error writing " + filename);
+}
+
+OrbitState read_orbit_state(const std::string& filename) {
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file) throw std::runtime_error("error opening file " + filename);
+  // every size in the header is checked against the file size before
+  // anything is allocated
+  const std::uint64_t file_size = file.tellg();
+  file.seekg(0);
+  const std::runtime_error corrupt(filename + " is truncated or corrupt");
+
+  OrbitState state;
+  char magic[sizeof(MAGIC)];
+  std::uint64_t parameters_size;
+  if (!file.read(magic, sizeof(magic)) ||
+      !std::equal(magic, magic + sizeof(magic), MAGIC) ||
+      !read_value(file, parameters_size)) {
+    throw std::runtime_error(filename + " is not an orbit state file");
+  }
+  if (parameters_size > file_size) throw corrupt;
+  state.parameters.resize(parameters_size);
+  std::int32_t iterations, width, height, num_seeds;
+  bool ok = file.read(&state.parameters[0], parameters_size) &&
+            read_value(file, iterations) && read_value(file, width) &&
+            read_value(file, height) && read_value(file, num_seeds) &&
+            width > 0 && height > 0 && num_seeds > 0;
+  if (!ok) throw corrupt;
+  const std::uint64_t num_values = static_cast<std::uint64_t>(width) * height;
+  if (num_values > file_size / sizeof(float)) throw corrupt;
+
+  std::uint64_t num_pixels;
+  ok = read_array(file, state.result, num_values) &&
+       read_value(file, num_pixels) && num_pixels <= num_values &&
+       num_pixels <= file_size / (2 * sizeof(float) * num_seeds) &&
+       read_array(file, state.pixels, num_pixels) &&
+       read_array(file, state.x, num_pixels * num_seeds) &&
+       read_array(file, state.y, num_pixels * num_seeds);
+  if (!ok) throw corrupt;
+  // deepen_grid indexes the result with the pixels
+  for (std::size_t i = 0; i < state.pixels.size(); i++) {
+    if (state.pixels[i] >= num_values ||
+        (i > 0 && state.pixels[i] <= state.pixels[i - 1])) {
+      throw corrupt;
+    }
+  }
+  state.iterations = iterations;
+  state.width = width;
+  state.height = height;
+  state.num_seeds = num_seeds;
+  return state;
+}
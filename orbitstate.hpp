@@ -0,0 +1,35 @@
+#ifndef ORBITSTATE_H
+#define ORBITSTATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Result of a run together with the final orbit states of its bounded
+// pixels, so that a later run can continue them to more iterations instead
+// of starting from the seeds again.
+struct OrbitState {
+  std::string parameters;  // describe_parameters() without the iterations
+  int iterations = 0;      // iterations done for the bounded pixels
+  int width = 0;
+  int height = 0;
+  int num_seeds = 0;
+  std::vector<float> result;          // width * height values
+  std::vector<std::uint64_t> pixels;  // indices of the bounded pixels
+  std::vector<float> x;               // num_seeds values per bounded pixel
+  std::vector<float> y;               // num_seeds values per bounded pixel
+};
+
+// removes the first line (the iterations) of a describe_parameters() text
+std::string parameters_without_iterations(const std::string& parameters);
+
+// orders the bounded pixels and their states by pixel index, which
+// read_orbit_state requires
+void sort_pixels(OrbitState& state);
+
+// both throw std::runtime_error on errors, read_orbit_state also if the
+// pixels are out of range or not increasing
+void write_orbit_state(const std::string& filename, const OrbitState& state);
+OrbitState read_orbit_state(const std::string& filename);
+
+#endif  // ORBITSTATE_H
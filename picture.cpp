@@ -1,14 +1,24 @@
 #include "picture.hpp"
 
-#include <cmath>
 #include <csetjmp>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <png.h>
+#include <zlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "colormaps.hpp"
 
@@ -33,57 +43,571 @@ class FileWrapper {
   operator FILE *() { return file_; }
 };
 
-// function: map result to color vector
-bool write_png(const char *filename, const float *result, float threshold,
-               int width, int height) {
-  std::vector<unsigned char> colors_gray(width * height);
-  std::vector<unsigned char> colors_rgb(3 * width * height);
-
-  for (int i = 0; i < width * height; ++i) {
-    if (result[i] > threshold) {
-      colors_gray[i] = 255;
-      colors_rgb[3 * i] = 255;
-      colors_rgb[3 * i + 1] = 255;
-      colors_rgb[3 * i + 2] = 255;
-    } else {
-      colors_gray[i] = std::floor(254 * result[i] / threshold);
-      // RGB color gradient: viridis from matplotlib
-      int idx = std::floor(255 * result[i] / threshold);
-
-      unsigned char r = std::floor(255 * viridis[idx][0]);
-      unsigned char g = std::floor(255 * viridis[idx][1]);
-      unsigned char b = std::floor(255 * viridis[idx][2]);
-
-      colors_rgb[3 * i] = r;      // red
-      colors_rgb[3 * i + 1] = g;  // green
-      colors_rgb[3 * i + 2] = b;  // blue
+namespace {
+
+const ColormapLut &colormap_lut(Colormap colormap) {
+  switch (colormap) {
+    case Colormap::magma:
+      return magma_lut;
+    case Colormap::inferno:
+      return inferno_lut;
+    case Colormap::plasma:
+      return plasma_lut;
+    default:
+      return viridis_lut;
+  }
+}
+
+// pixels per block of ColorScale::indices
+constexpr int COLORIZE_BLOCK = 256;
+
+// positions of the gamma table
+constexpr int GAMMA_LEVELS = 65536;
+
+}  // namespace
+
+ColorScale::ColorScale(float threshold, const PngOptions &options)
+    : threshold_(threshold),
+      low_(options.clip_min),
+      range_((options.clip_max > 0 ? options.clip_max : threshold) -
+             options.clip_min),
+      invert_(options.invert),
+      colormap_(options.colormap) {
+  if (options.gamma != 1) {
+    gamma_table_.resize(GAMMA_LEVELS);
+    for (int level = 0; level < GAMMA_LEVELS; level++) {
+      double position = std::pow(static_cast<double>(level) /
+                                     (GAMMA_LEVELS - 1),
+                                 1.0 / options.gamma);
+      int index = static_cast<int>(255 * position);
+      gamma_table_[level] = invert_ ? 255 - index : index;
+    }
+  }
+}
+
+// floor(255 * (value - low) / range) clamped to 0..255 (through the gamma
+// table if any), or 256 (white) above threshold. Branch free on integers, so
+// that it vectorizes: the comparison uses the bit patterns, which are ordered
+// like the values for non-negative floats.
+void ColorScale::indices(const float *values, int size,
+                         std::int32_t *indices) const {
+  std::int32_t threshold_bits;
+  std::memcpy(&threshold_bits, &threshold_, sizeof(threshold_));
+  const float low = low_;
+  const float range = range_;
+  if (!gamma_table_.empty()) {
+    const unsigned char *table = gamma_table_.data();
+    for (int i = 0; i < size; i++) {
+      std::int32_t bits;
+      std::memcpy(&bits, &values[i], sizeof(bits));
+      float position = (GAMMA_LEVELS - 1) * (values[i] - low) / range;
+      position = std::min(std::max(position, 0.0f), GAMMA_LEVELS - 1.0f);
+      std::int32_t level = static_cast<std::int32_t>(position);
+      level = std::min(std::max(level, 0), GAMMA_LEVELS - 1);  // NaN
+      std::int32_t index = table[level];
+      std::int32_t escaped = bits > threshold_bits;
+      indices[i] = index + escaped * (256 - index);
+    }
+    return;
+  }
+  const std::int32_t flip = invert_ ? 255 : 0;
+  const std::int32_t sign = invert_ ? -1 : 1;
+#pragma omp simd
+  for (int i = 0; i < size; i++) {
+    std::int32_t bits;
+    std::memcpy(&bits, &values[i], sizeof(bits));
+    // clamped as float first, far beyond the clipping range the conversion
+    // would overflow
+    float position = 255 * (values[i] - low) / range;
+    position = std::min(std::max(position, 0.0f), 255.0f);
+    std::int32_t index = static_cast<std::int32_t>(position);
+    index = flip + sign * std::min(std::max(index, 0), 255);
+    std::int32_t escaped = bits > threshold_bits;
+    indices[i] = index + escaped * (256 - index);
+  }
+}
+
+void ColorScale::colorize(const float *values, std::size_t size,
+                          unsigned char *rgb) const {
+  const ColormapLut &lut = colormap_lut(colormap_);
+  alignas(64) std::int32_t block_indices[COLORIZE_BLOCK];
+  for (std::size_t first = 0; first < size; first += COLORIZE_BLOCK) {
+    int block = std::min<std::size_t>(COLORIZE_BLOCK, size - first);
+    indices(values + first, block, block_indices);
+    unsigned char *out = rgb + 3 * first;
+    for (int i = 0; i < block; i++) {
+      const unsigned char *color = lut.rgb[block_indices[i]];
+      out[3 * i] = color[0];      // red
+      out[3 * i + 1] = color[1];  // green
+      out[3 * i + 2] = color[2];  // blue
+    }
+  }
+}
+
+void gray_levels(const float *values, std::size_t size, float threshold,
+                 std::uint16_t *levels) {
+  std::int32_t threshold_bits;
+  std::memcpy(&threshold_bits, &threshold, sizeof(threshold));
+  // like ColorScale::indices
+#pragma omp simd
+  for (std::size_t i = 0; i < size; i++) {
+    std::int32_t bits;
+    std::memcpy(&bits, &values[i], sizeof(bits));
+    std::int32_t level =
+        static_cast<std::int32_t>(65534 * values[i] / threshold);
+    level = std::min(std::max(level, 0), 65534);
+    std::int32_t escaped = bits > threshold_bits;
+    levels[i] = level + escaped * (65535 - level);
+  }
+}
+
+void colorize(const float *values, std::size_t size, float threshold,
+              Colormap colormap, unsigned char *rgb) {
+  PngOptions options;
+  options.colormap = colormap;
+  ColorScale(threshold, options).colorize(values, size, rgb);
+}
+
+namespace {
+
+int libpng_filter(PngFilter filter) {
+  switch (filter) {
+    case PngFilter::none:
+      return PNG_FILTER_NONE;
+    case PngFilter::sub:
+      return PNG_FILTER_SUB;
+    case PngFilter::up:
+      return PNG_FILTER_UP;
+    case PngFilter::average:
+      return PNG_FILTER_AVG;
+    case PngFilter::paeth:
+      return PNG_FILTER_PAETH;
+    default:
+      return PNG_ALL_FILTERS;
+  }
+}
+
+// filtered bytes per stripe, as in pigz large enough that the stripes
+// compress nearly as well as one stream
+constexpr std::size_t STRIPE_BYTES = 128 * 1024;
+
+// deflate window, each stripe is primed with this much of the previous one
+constexpr std::size_t WINDOW_BYTES = 32 * 1024;
+
+inline unsigned char paeth(int a, int b, int c) {
+  int p = a + b - c;
+  int pa = std::abs(p - a);
+  int pb = std::abs(p - b);
+  int pc = std::abs(p - c);
+  if (pa <= pb && pa <= pc) return a;
+  if (pb <= pc) return b;
+  return c;
+}
+
+// writes filter type and filtered bytes of row, prior is the row above
+// (nullptr for the first row). The adaptive filter tries the others in
+// candidate, length + 1 bytes.
+void filter_row(PngFilter filter, const unsigned char *row,
+                const unsigned char *prior, int length, int bytes_per_pixel,
+                unsigned char *out, unsigned char *candidate) {
+  if (filter == PngFilter::adaptive) {
+    // the filter with the smallest sum of the bytes as signed values
+    long best_sum = -1;
+    for (PngFilter f : {PngFilter::none, PngFilter::sub, PngFilter::up,
+                        PngFilter::average, PngFilter::paeth}) {
+      filter_row(f, row, prior, length, bytes_per_pixel, candidate, nullptr);
+      long sum = 0;
+      for (int i = 1; i <= length; i++) {
+        sum += std::abs(static_cast<signed char>(candidate[i]));
+      }
+      if (best_sum < 0 || sum < best_sum) {
+        best_sum = sum;
+        std::copy(candidate, candidate + length + 1, out);
+      }
     }
+    return;
   }
 
-  FileWrapper file(filename, "wb");
-  png_structp png =
-      png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (!png) return false;
+  const int bpp = bytes_per_pixel;
+  out[0] = static_cast<unsigned char>(filter);
+  for (int i = 0; i < length; i++) {
+    int a = i >= bpp ? row[i - bpp] : 0;
+    int b = prior ? prior[i] : 0;
+    int c = prior && i >= bpp ? prior[i - bpp] : 0;
+    int predicted = 0;
+    switch (filter) {
+      case PngFilter::sub:
+        predicted = a;
+        break;
+      case PngFilter::up:
+        predicted = b;
+        break;
+      case PngFilter::average:
+        predicted = (a + b) / 2;
+        break;
+      case PngFilter::paeth:
+        predicted = paeth(a, b, c);
+        break;
+      default:
+        break;
+    }
+    out[i + 1] = static_cast<unsigned char>(row[i] - predicted);
+  }
+}
+
+// raw deflate of input primed with dictionary, ends with a sync flush so
+// that the next stripe can follow, or with the final block if last
+std::vector<unsigned char> deflate_stripe(const unsigned char *input,
+                                          std::size_t length,
+                                          const unsigned char *dictionary,
+                                          std::size_t dictionary_length,
+                                          int level, bool last) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK) {
+    throw std::runtime_error("error initializing deflate");
+  }
+  if (dictionary_length > 0) {
+    deflateSetDictionary(&stream, dictionary, dictionary_length);
+  }
+  std::vector<unsigned char> output(deflateBound(&stream, length) + 16);
+  stream.next_in = const_cast<unsigned char *>(input);
+  stream.avail_in = length;
+  stream.next_out = output.data();
+  stream.avail_out = output.size();
+  int status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+  std::size_t written = output.size() - stream.avail_out;
+  deflateEnd(&stream);
+  if (status != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+    throw std::runtime_error("error compressing PNG stripe");
+  }
+  output.resize(written);
+  return output;
+}
 
-  png_infop info = png_create_info_struct(png);
-  if (!info) return false;
+void put_uint32(std::uint32_t value, unsigned char *out) {
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+void write_chunk(FILE *file, const char *type, const unsigned char *data,
+                 std::size_t length) {
+  unsigned char header[8];
+  put_uint32(length, header);
+  std::copy(type, type + 4, header + 4);
+  uLong crc = crc32(0, header + 4, 4);
+  if (length > 0) crc = crc32(crc, data, length);  // nullptr would reset it
+  unsigned char trailer[4];
+  put_uint32(crc, trailer);
+  if (std::fwrite(header, 1, 8, file) != 8 ||
+      std::fwrite(data, 1, length, file) != length ||
+      std::fwrite(trailer, 1, 4, file) != 4) {
+    throw std::runtime_error("error writing PNG");
+  }
+}
+
+}  // namespace
 
-  if (setjmp(png_jmpbuf(png))) return false;
+struct PngWriter::State {
+  FileWrapper file;
+  png_structp png = nullptr;  // libpng, one thread only
+  png_infop info = nullptr;
+  std::vector<unsigned char> row;  // the current row
+  std::vector<std::uint16_t> levels;
 
-  png_init_io(png, file);
+  // Parallel compression: the rows of a batch of stripes are collected after
+  // the last row of the previous batch (needed to filter the first one),
+  // then filtered and deflated on the threads, each stripe primed with the
+  // filtered bytes before it. Only the batch is kept in memory.
+  int num_threads = 1;
+  int bytes_per_pixel = 3;
+  int level = 6;
+  PngFilter filter = PngFilter::adaptive;
+  std::size_t row_length = 0;  // bytes of a row without the filter type
+  int rows_per_stripe = 0;
+  int batch_rows = 0;
+  int rows_in_batch = 0;
+  bool have_prior = false;  // rows holds the row above the batch
+  std::vector<unsigned char> rows;  // prior row and rows of the batch
+  // the last WINDOW_BYTES filtered bytes of the previous batch (fewer at
+  // the start of the image), then the filtered rows of the batch
+  std::vector<unsigned char> filtered;
+  std::size_t window_length = 0;
+  std::vector<std::vector<unsigned char>> candidates;  // per thread
+  std::vector<std::vector<unsigned char>> stripes;
+  std::vector<uLong> checksums;
+  uLong checksum = adler32(0, nullptr, 0);
 
-  // Output is 8bit depth, RGBA format.
-  png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
-               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
-               PNG_FILTER_TYPE_DEFAULT);
-  png_write_info(png, info);
+  explicit State(const std::string &filename) : file(filename, "wb") {}
 
-  std::vector<png_bytep> row_pointers(height);
-  const int row_stride = width * 3;
-  for (int i = 0; i < row_pointers.size(); ++i)
-    row_pointers[i] = colors_rgb.data() + i * row_stride;
+  ~State() {
+    if (png) png_destroy_write_struct(&png, info ? &info : nullptr);
+  }
 
-  png_write_image(png, row_pointers.data());
-  png_write_end(png, NULL);
-  return true;
+  unsigned char *batch_row(int r) {
+    return rows.data() + (r + 1) * row_length;
+  }
+
+  // filters and deflates the collected rows, the last batch ends the zlib
+  // stream
+  void compress_batch(bool last) {
+    const std::size_t filtered_length = row_length + 1;
+    const int num_rows = rows_in_batch;
+#pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int r = 0; r < num_rows; r++) {
+      int thread = 0;
+#ifdef _OPENMP
+      thread = omp_get_thread_num();
+#endif
+      filter_row(filter, batch_row(r),
+                 r > 0 || have_prior ? batch_row(r - 1) : nullptr,
+                 row_length, bytes_per_pixel,
+                 filtered.data() + window_length + r * filtered_length,
+                 candidates[thread].data());
+    }
+
+    int num_stripes = (num_rows + rows_per_stripe - 1) / rows_per_stripe;
+    std::vector<char> failed(num_stripes, 0);
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (int s = 0; s < num_stripes; s++) {
+      std::size_t begin = window_length + s * rows_per_stripe * filtered_length;
+      std::size_t end =
+          window_length +
+          std::min(num_rows, (s + 1) * rows_per_stripe) * filtered_length;
+      std::size_t dictionary_length = std::min(begin, WINDOW_BYTES);
+      try {
+        stripes[s] = deflate_stripe(
+            filtered.data() + begin, end - begin,
+            filtered.data() + begin - dictionary_length, dictionary_length,
+            level, last && s == num_stripes - 1);
+      } catch (std::runtime_error &) {
+        failed[s] = 1;
+      }
+      checksums[s] = adler32(adler32(0, nullptr, 0), filtered.data() + begin,
+                             end - begin);
+    }
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+      throw std::runtime_error("error compressing PNG stripe");
+    }
+    for (int s = 0; s < num_stripes; s++) {
+      std::size_t rows =
+          std::min(num_rows, (s + 1) * rows_per_stripe) - s * rows_per_stripe;
+      checksum =
+          adler32_combine(checksum, checksums[s], rows * filtered_length);
+      write_chunk(file, "IDAT", stripes[s].data(), stripes[s].size());
+    }
+
+    // keep the last row and the end of the filtered bytes for the next batch
+    std::copy(batch_row(num_rows - 1), batch_row(num_rows), rows.begin());
+    have_prior = true;
+    std::size_t filtered_end = window_length + num_rows * filtered_length;
+    std::size_t window = std::min(filtered_end, WINDOW_BYTES);
+    std::copy(filtered.begin() + (filtered_end - window),
+              filtered.begin() + filtered_end, filtered.begin());
+    window_length = window;
+    rows_in_batch = 0;
+  }
+};
+
+// libpng reports errors by longjmp to the setjmp of the calling function
+#define PNG_TRY(state)                             \
+  if (setjmp(png_jmpbuf((state).png))) {           \
+    throw std::runtime_error("error writing PNG"); \
+  }
+
+PngWriter::PngWriter(const std::string &filename, float threshold, int width,
+                     int height, const PngOptions &options, PngFormat format)
+    : state_(new State(filename)),
+      threshold_(threshold),
+      width_(width),
+      height_(height),
+      colors_(threshold, options),
+      format_(format) {
+  State &state = *state_;
+  state.bytes_per_pixel = format == PngFormat::gray16 ? 2 : 3;
+  state.row_length = state.bytes_per_pixel * static_cast<std::size_t>(width);
+  if (format == PngFormat::gray16) state.levels.resize(width);
+
+  state.num_threads = options.num_threads;
+#ifdef _OPENMP
+  if (state.num_threads == 0) state.num_threads = omp_get_max_threads();
+#else
+  // stripes are compressed one after the other without OpenMP
+  if (state.num_threads == 0) state.num_threads = 1;
+#endif
+  if (state.num_threads > 1) {
+    state.level = options.compression_level;
+    state.filter = options.filter;
+    const std::size_t filtered_length = state.row_length + 1;
+    state.rows_per_stripe =
+        std::max<std::size_t>(1, STRIPE_BYTES / filtered_length);
+    // two stripes per thread balance the stripes of different cost
+    int batch_stripes = 2 * state.num_threads;
+    state.batch_rows = std::min(height, batch_stripes * state.rows_per_stripe);
+    state.rows.resize((state.batch_rows + 1) * state.row_length);
+    state.filtered.resize(WINDOW_BYTES + state.batch_rows * filtered_length);
+    state.candidates.assign(state.num_threads,
+                            std::vector<unsigned char>(filtered_length));
+    state.stripes.resize(batch_stripes);
+    state.checksums.resize(batch_stripes);
+
+    static const unsigned char signature[8] = {137, 80, 78, 71,
+                                               13,  10, 26, 10};
+    if (std::fwrite(signature, 1, 8, state.file) != 8) {
+      throw std::runtime_error("error writing PNG");
+    }
+    // 8bit RGB or 16bit gray, deflate, adaptive filtering, no interlace
+    unsigned char ihdr[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0};
+    if (format == PngFormat::gray16) {
+      ihdr[8] = 16;
+      ihdr[9] = 0;
+    }
+    put_uint32(width, ihdr);
+    put_uint32(height, ihdr + 4);
+    write_chunk(state.file, "IHDR", ihdr, sizeof(ihdr));
+
+    // zlib header with the level hint of zlib, (cmf * 256 + flg) % 31 == 0
+    int level = options.compression_level;
+    int level_hint = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    unsigned char zlib_header[2] = {
+        0x78, static_cast<unsigned char>(level_hint << 6)};
+    zlib_header[1] += 31 - (0x78 * 256 + zlib_header[1]) % 31;
+    write_chunk(state.file, "IDAT", zlib_header, 2);
+    return;
+  }
+
+  state.row.resize(state.row_length);
+  state.png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!state.png) throw std::runtime_error("error creating PNG " + filename);
+  state.info = png_create_info_struct(state.png);
+  if (!state.info) throw std::runtime_error("error creating PNG " + filename);
+
+  PNG_TRY(state);
+  png_init_io(state.png, state.file);
+
+  // Output is 8bit depth RGB or 16bit gray.
+  if (format == PngFormat::gray16) {
+    png_set_IHDR(state.png, state.info, width, height, 16,
+                 PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  } else {
+    png_set_IHDR(state.png, state.info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                 PNG_FILTER_TYPE_DEFAULT);
+  }
+  png_set_compression_level(state.png, options.compression_level);
+  png_set_filter(state.png, PNG_FILTER_TYPE_BASE, libpng_filter(options.filter));
+  png_write_info(state.png, state.info);
+}
+
+PngWriter::~PngWriter() = default;
+
+void PngWriter::write_row(const float *row) {
+  if (rows_written_ == height_) {
+    throw std::runtime_error("PNG row written after the last one");
+  }
+  State &state = *state_;
+  unsigned char *out = state.png ? state.row.data()
+                                 : state.batch_row(state.rows_in_batch);
+  if (format_ == PngFormat::gray16) {
+    gray_levels(row, width_, threshold_, state.levels.data());
+    // PNG samples are big endian
+    for (int i = 0; i < width_; i++) {
+      out[2 * i] = state.levels[i] >> 8;
+      out[2 * i + 1] = state.levels[i] & 0xff;
+    }
+  } else {
+    colors_.colorize(row, width_, out);
+  }
+  rows_written_++;
+  if (state.png) {
+    PNG_TRY(state);
+    png_write_row(state.png, out);
+  } else if (++state.rows_in_batch == state.batch_rows ||
+             rows_written_ == height_) {
+    state.compress_batch(rows_written_ == height_);
+  }
+}
+
+void PngWriter::finish() {
+  if (rows_written_ != height_) {
+    throw std::runtime_error("PNG finished after " +
+                             std::to_string(rows_written_) + " of " +
+                             std::to_string(height_) + " rows");
+  }
+  State &state = *state_;
+  if (state.png) {
+    PNG_TRY(state);
+    png_write_end(state.png, NULL);
+  } else {
+    unsigned char trailer[4];
+    put_uint32(state.checksum, trailer);
+    write_chunk(state.file, "IDAT", trailer, 4);
+    write_chunk(state.file, "IEND", nullptr, 0);
+  }
+  if (std::fflush(state.file) != 0) {
+    throw std::runtime_error("error writing PNG");
+  }
+}
+
+PfmWriter::PfmWriter(const std::string &filename, int width, int height)
+    : file_(std::fopen(filename.c_str(), "wb")),
+      filename_(filename),
+      width_(width),
+      height_(height) {
+  if (!file_) throw std::runtime_error("error opening file " + filename);
+  // a negative scale marks little endian data
+  const std::uint16_t byte_order = 1;
+  bool little_endian = *reinterpret_cast<const unsigned char *>(&byte_order);
+  std::string header = "Pf\n" + std::to_string(width) + " " +
+                       std::to_string(height) + "\n" +
+                       (little_endian ? "-1.0" : "1.0") + "\n";
+  header_size_ = header.size();
+  if (std::fwrite(header.data(), 1, header.size(), file_) != header.size()) {
+    std::fclose(file_);
+    throw std::runtime_error("error writing " + filename);
+  }
+}
+
+PfmWriter::~PfmWriter() {
+  if (file_) std::fclose(file_);
+}
+
+void PfmWriter::write_row(const float *row) {
+  // 64 bit offsets for results larger than 2 GB
+  std::int64_t offset =
+      header_size_ + static_cast<std::int64_t>(height_ - 1 - rows_written_) *
+                         width_ * sizeof(float);
+#ifdef _WIN32
+  bool ok = _fseeki64(file_, offset, SEEK_SET) == 0;
+#else
+  bool ok = fseeko(file_, offset, SEEK_SET) == 0;
+#endif
+  if (!ok || std::fwrite(row, sizeof(float), width_, file_) !=
+                 static_cast<std::size_t>(width_)) {
+    throw std::runtime_error("error writing " + filename_);
+  }
+  rows_written_++;
+}
+
+void PfmWriter::finish() {
+  if (rows_written_ != height_) {
+    throw std::runtime_error("PFM finished after " +
+                             std::to_string(rows_written_) + " of " +
+                             std::to_string(height_) + " rows");
+  }
+  int status = std::fclose(file_);
+  file_ = nullptr;
+  if (status != 0) throw std::runtime_error("error writing " + filename_);
+}
+
+void write_png(const char *filename, const float *result, float threshold,
+               int width, int height, const PngOptions &options) {
+  PngWriter writer(filename, threshold, width, height, options);
+  for (int r = 0; r < height; ++r) {
+    writer.write_row(result + static_cast<std::size_t>(r) * width);
+  }
+  writer.finish();
 }
@@ -1,7 +1,132 @@
 #ifndef PICTURE_H
 #define PICTURE_H
 
-bool write_png(const char *filename, const float *result, float threshold,
-               int width, int height);
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// PNG row filters, adaptive picks the filter with the smallest sum of
+// absolute differences per row like libpng
+enum class PngFilter { none, sub, up, average, paeth, adaptive };
+
+enum class Colormap { magma, inferno, plasma, viridis };
+
+// colors and compression of a PNG
+struct PngOptions {
+  Colormap colormap = Colormap::viridis;
+  // a value v takes the color at ((v - clip_min) / (clip_max - clip_min))^(1
+  // / gamma) of the colormap, clamped to 0..1, clip_max 0 for the threshold.
+  // Values above the threshold stay white.
+  float clip_min = 0;
+  float clip_max = 0;
+  float gamma = 1;
+  bool invert = false;  // the colormap from its last color to its first
+  int compression_level = 6;  // zlib level 0 (stored) to 9 (smallest)
+  PngFilter filter = PngFilter::adaptive;
+  // PngWriter compresses stripes of rows on this many threads and stitches
+  // them into one zlib stream like pigz, keeping only a batch of stripes in
+  // memory. 1 uses libpng, 0 for the default.
+  int num_threads = 0;
+};
+
+// colors size result values into 8bit RGB, values above threshold are
+// white, the others follow the colormap
+void colorize(const float *values, std::size_t size, float threshold,
+              Colormap colormap, unsigned char *rgb);
+
+// the colors of result values with the colormap, clipping, gamma and
+// inversion of a PngOptions, set up once per image
+class ColorScale {
+ public:
+  ColorScale(float threshold, const PngOptions &options);
+
+  // colors size values into 8bit RGB like colorize
+  void colorize(const float *values, std::size_t size,
+                unsigned char *rgb) const;
+
+ private:
+  // lookup table entries of values, 256 (white) above threshold
+  void indices(const float *values, int size, std::int32_t *indices) const;
+
+  float threshold_;
+  float low_;
+  float range_;
+  bool invert_;
+  Colormap colormap_;
+  // entry of the colormap of 65536 evenly spaced positions with gamma and
+  // inversion applied, empty for gamma 1
+  std::vector<unsigned char> gamma_table_;
+};
+
+// maps size result values to 16bit gray levels, floor(65534 * value /
+// threshold) and 65535 above threshold
+void gray_levels(const float *values, std::size_t size, float threshold,
+                 std::uint16_t *levels);
+
+// An image written row by row from top to bottom, so that only a single row
+// is ever held in memory. Throws std::runtime_error on errors.
+class RowWriter {
+ public:
+  virtual ~RowWriter() = default;
+
+  virtual void write_row(const float *row) = 0;
+
+  // completes the file after all rows
+  virtual void finish() = 0;
+};
+
+enum class PngFormat {
+  rgb8,   // colored with the colormap
+  gray16  // 16bit gray levels, see gray_levels
+};
+
+class PngWriter : public RowWriter {
+ public:
+  PngWriter(const std::string &filename, float threshold, int width,
+            int height, const PngOptions &options = PngOptions(),
+            PngFormat format = PngFormat::rgb8);
+  ~PngWriter() override;
+
+  void write_row(const float *row) override;
+  void finish() override;
+
+ private:
+  struct State;
+  std::unique_ptr<State> state_;
+  float threshold_;
+  int width_;
+  int height_;
+  ColorScale colors_;
+  PngFormat format_;
+  int rows_written_ = 0;
+};
+
+// Portable float map (grayscale "Pf") of the raw values. PFM stores the rows
+// from bottom to top, so each row is written at its place in the file.
+class PfmWriter : public RowWriter {
+ public:
+  PfmWriter(const std::string &filename, int width, int height);
+  ~PfmWriter() override;
+
+  void write_row(const float *row) override;
+  void finish() override;
+
+ private:
+  std::FILE *file_;
+  std::string filename_;
+  long header_size_;
+  int width_;
+  int height_;
+  int rows_written_ = 0;
+};
+
+// writes the whole result as colored PNG, throws std::runtime_error on
+// errors
+void write_png(const char *filename, const float *result, float threshold,
+               int width, int height,
+               const PngOptions &options = PngOptions());
 
 #endif
@@ -0,0 +1,202 @@
+#include "rawresult.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char MAGIC[8] = {'D', 'S', 'R', 'A', 'W', '0', '0', '1'};
+const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+const std::size_t FIXED_HEADER_SIZE = 40;
+const std::size_t DATA_ALIGNMENT = 64;
+
+struct Header {
+  std::uint32_t byte_order;
+  std::uint32_t dtype;
+  std::int32_t width;
+  std::int32_t height;
+  std::uint64_t data_offset;
+  std::uint64_t parameters_size;
+};
+
+// parses the header at the start of a file of file_size bytes
+Header parse_header(const char* bytes, std::size_t file_size,
+                    const std::string& filename) {
+  Header header;
+  if (file_size < FIXED_HEADER_SIZE ||
+      std::memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0) {
+    throw std::runtime_error(filename + " is not a result file");
+  }
+  std::memcpy(&header, bytes + sizeof(MAGIC), sizeof(header));
+  if (header.byte_order != BYTE_ORDER_MARK) {
+    throw std::runtime_error(filename + " has a foreign byte order");
+  }
+  if (header.dtype != static_cast<std::uint32_t>(RawType::float32)) {
+    throw std::runtime_error(filename + " has an unsupported data type");
+  }
+  std::uint64_t data_size = static_cast<std::uint64_t>(header.width) *
+                            header.height * sizeof(float);
+  if (header.width < 1 || header.height < 1 ||
+      header.data_offset % DATA_ALIGNMENT != 0 ||
+      FIXED_HEADER_SIZE + header.parameters_size > header.data_offset ||
+      header.data_offset + data_size > file_size) {
+    throw std::runtime_error(filename + " is truncated or corrupt");
+  }
+  return header;
+}
+
+// the header up to the data offset
+std::vector<char> make_header(const std::string& parameters, int width,
+                              int height) {
+  Header header;
+  header.byte_order = BYTE_ORDER_MARK;
+  header.dtype = static_cast<std::uint32_t>(RawType::float32);
+  header.width = width;
+  header.height = height;
+  header.parameters_size = parameters.size();
+  header.data_offset =
+      (FIXED_HEADER_SIZE + parameters.size() + DATA_ALIGNMENT - 1) /
+      DATA_ALIGNMENT * DATA_ALIGNMENT;
+
+  std::vector<char> bytes(header.data_offset, '\0');
+  std::memcpy(bytes.data(), MAGIC, sizeof(MAGIC));
+  std::memcpy(bytes.data() + sizeof(MAGIC), &header, sizeof(header));
+  std::memcpy(bytes.data() + FIXED_HEADER_SIZE, parameters.data(),
+              parameters.size());
+  return bytes;
+}
+
+}  // namespace
+
+void write_raw(const std::string& filename, const std::string& parameters,
+               const float* result, int width, int height) {
+  std::vector<char> bytes = make_header(parameters, width, height);
+
+  std::FILE* file = std::fopen(filename.c_str(), "wb");
+  if (!file) throw std::runtime_error("error opening file " + filename);
+  std::size_t size = static_cast<std::size_t>(width) * height;
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size() &&
+            std::fwrite(result, sizeof(float), size, file) == size;
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) throw std::runtime_error("error writing " + filename);
+}
+
+RawResult::RawResult(const std::string& filename) {
+  const char* bytes;
+  std::size_t file_size;
+#ifdef _WIN32
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file) throw std::runtime_error("error opening file " + filename);
+  file_size = file.tellg();
+  // float buffer, so that the data is aligned like the offset in the file
+  buffer_.resize((file_size + sizeof(float) - 1) / sizeof(float));
+  file.seekg(0);
+  if (!file.read(reinterpret_cast<char*>(buffer_.data()), file_size)) {
+    throw std::runtime_error("error reading " + filename);
+  }
+  bytes = reinterpret_cast<const char*>(buffer_.data());
+#else
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("error opening file " + filename);
+  struct stat status;
+  if (fstat(fd, &status) != 0 || status.st_size == 0) {
+    close(fd);
+    throw std::runtime_error(filename + " is not a result file");
+  }
+  file_size = status.st_size;
+  void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("error mapping file " + filename);
+  }
+  mapping_ = mapping;
+  mapping_size_ = file_size;
+  bytes = static_cast<const char*>(mapping);
+#endif
+
+  try {
+    Header header = parse_header(bytes, file_size, filename);
+    parameters_.assign(bytes + FIXED_HEADER_SIZE, header.parameters_size);
+    width_ = header.width;
+    height_ = header.height;
+    data_ = reinterpret_cast<const float*>(bytes + header.data_offset);
+  } catch (...) {
+#ifndef _WIN32
+    munmap(mapping_, mapping_size_);
+#endif
+    throw;
+  }
+}
+
+RawResult::~RawResult() {
+#ifndef _WIN32
+  if (mapping_) munmap(mapping_, mapping_size_);
+#endif
+}
+
+MappedRawResult::MappedRawResult(const std::string& filename,
+                                 const std::string& parameters, int width,
+                                 int height)
+    : filename_(filename), width_(width), height_(height) {
+#ifdef _WIN32
+  throw std::runtime_error("memory mapped results are not supported on "
+                           "Windows");
+#else
+  std::vector<char> header = make_header(parameters, width, height);
+  std::size_t file_size = header.size() + size() * sizeof(float);
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw std::runtime_error("error opening file " + filename);
+  // the data part stays sparse until it is written
+  bool ok = ftruncate(fd, file_size) == 0;
+  void* mapping = ok ? mmap(nullptr, file_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0)
+                     : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("error mapping file " + filename);
+  }
+  mapping_ = mapping;
+  mapping_size_ = file_size;
+  std::memcpy(mapping, header.data(), header.size());
+  data_ = reinterpret_cast<float*>(static_cast<char*>(mapping) +
+                                   header.size());
+#endif
+}
+
+MappedRawResult::~MappedRawResult() {
+#ifndef _WIN32
+  if (mapping_) munmap(mapping_, mapping_size_);
+#endif
+}
+
+void MappedRawResult::release(std::size_t first, std::size_t count) {
+#ifndef _WIN32
+  // whole pages only, the file keeps the values of a shared mapping
+  const std::size_t page = sysconf(_SC_PAGESIZE);
+  std::size_t begin = reinterpret_cast<std::size_t>(data_ + first);
+  std::size_t end = reinterpret_cast<std::size_t>(data_ + first + count);
+  begin = (begin + page - 1) / page * page;
+  end = end / page * page;
+  if (begin < end) {
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+  }
+#endif
+}
+
+void MappedRawResult::sync() {
+#ifndef _WIN32
+  if (msync(mapping_, mapping_size_, MS_SYNC) != 0) {
+    throw std::runtime_error("error writing " + filename_);
+  }
+#endif
+}
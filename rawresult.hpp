@@ -0,0 +1,89 @@
+#ifndef RAWRESULT_H
+#define RAWRESULT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary result file, all numbers in native byte order:
+//   offset  0: char[8]  magic "DSRAW001"
+//   offset  8: uint32   byte order mark 0x01020304
+//   offset 12: uint32   dtype, 0 = float32
+//   offset 16: int32    width (alpha values)
+//   offset 20: int32    height (beta values)
+//   offset 24: uint64   data offset, a multiple of 64
+//   offset 32: uint64   size of the parameter description
+//   offset 40: char[]   parameter description (see describe_parameters)
+//   data offset: width * height values, row by row from the largest beta
+//                to the smallest, like the result of compute_grid
+enum class RawType : std::uint32_t { float32 = 0 };
+
+// writes the header and the data with one large write each, throws
+// std::runtime_error on errors
+void write_raw(const std::string& filename, const std::string& parameters,
+               const float* result, int width, int height);
+
+// Read only view of a result file. The file is memory mapped, so the data
+// is not copied and only the pages actually used are read (on Windows the
+// file is read into memory instead).
+class RawResult {
+ public:
+  // throws std::runtime_error if the file can not be opened or is invalid
+  explicit RawResult(const std::string& filename);
+  ~RawResult();
+  RawResult(const RawResult&) = delete;
+  RawResult& operator=(const RawResult&) = delete;
+
+  const std::string& parameters() const { return parameters_; }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  std::size_t size() const { return static_cast<std::size_t>(width_) * height_; }
+  // 64 byte aligned pointer to the width * height values
+  const float* data() const { return data_; }
+
+ private:
+  std::string parameters_;
+  int width_ = 0;
+  int height_ = 0;
+  const float* data_ = nullptr;
+
+  void* mapping_ = nullptr;
+  std::size_t mapping_size_ = 0;
+  std::vector<float> buffer_;  // used without mmap
+};
+
+// Writable result file, created with its full size and memory mapped, so
+// that a grid larger than the memory can be computed directly into it. The
+// system writes the pages back to the file as needed. Only with mmap, throws
+// std::runtime_error on Windows.
+class MappedRawResult {
+ public:
+  // creates (or replaces) the file, throws std::runtime_error on errors
+  MappedRawResult(const std::string& filename, const std::string& parameters,
+                  int width, int height);
+  ~MappedRawResult();
+  MappedRawResult(const MappedRawResult&) = delete;
+  MappedRawResult& operator=(const MappedRawResult&) = delete;
+
+  std::size_t size() const { return static_cast<std::size_t>(width_) * height_; }
+  // 64 byte aligned pointer to the width * height values
+  float* data() { return data_; }
+
+  // drops the values first..first + count - 1 from the memory of the process,
+  // they stay in the file
+  void release(std::size_t first, std::size_t count);
+
+  // writes all values back to the file, throws std::runtime_error on errors
+  void sync();
+
+ private:
+  std::string filename_;
+  int width_;
+  int height_;
+  float* data_ = nullptr;
+  void* mapping_ = nullptr;
+  std::size_t mapping_size_ = 0;
+};
+
+#endif  // RAWRESULT_H
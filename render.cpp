@@ -0,0 +1,175 @@
+#include "render.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "rawresult.hpp"
+
+std::string RenderResult::parameters() const {
+  return describe_parameters(grid.num_iterations, grid.threshold,
+                             grid.alphamin, grid.alphamax,
+                             grid.alpha_num_intervals, grid.betamin,
+                             grid.betamax, grid.beta_num_intervals, seed_x,
+                             seed_y, options);
+}
+
+std::vector<std::unique_ptr<RowWriter>> open_images(
+    float threshold, int width, int height, const ComputeOptions& options) {
+  std::vector<std::unique_ptr<RowWriter>> images;
+  if (!options.png_output.empty()) {
+    images.emplace_back(new PngWriter(options.png_output, threshold, width,
+                                      height, options.png));
+  }
+  if (!options.gray16_output.empty()) {
+    images.emplace_back(new PngWriter(options.gray16_output, threshold, width,
+                                      height, options.png, PngFormat::gray16));
+  }
+  if (!options.pfm_output.empty()) {
+    images.emplace_back(new PfmWriter(options.pfm_output, width, height));
+  }
+  return images;
+}
+
+void ImageSink::consume(const RenderResult& result) {
+  const ComputeOptions& options = result.options;
+  int width = result.grid.width();
+  int height = result.grid.height();
+  float threshold = result.grid.threshold;
+  std::vector<std::unique_ptr<RowWriter>> images =
+      open_images(threshold, width, height, options);
+  if (images.empty() && !mapped_) return;
+  for (int r = 0; r < height; r++) {
+    std::size_t first_pixel = static_cast<std::size_t>(r) * width;
+    for (auto& image : images) image->write_row(result.values + first_pixel);
+    // out of core, the rows already written are dropped from memory
+    if (mapped_) mapped_->release(first_pixel, width);
+  }
+  for (auto& image : images) image->finish();
+}
+
+void RawSink::consume(const RenderResult& result) {
+  write_raw(filename_, result.parameters(), result.values,
+            result.grid.width(), result.grid.height());
+}
+
+void CsvSink::consume(const RenderResult& result) {
+  bytes_ = write_csv(filename_, result.values, result.alphas.data(),
+                     result.grid.width(), result.betas.data(),
+                     result.grid.height(), format_);
+}
+
+namespace {
+
+// bytes of the result kept in memory by RenderEngine::render into a mapped
+// result
+constexpr std::size_t BAND_BYTES = std::size_t(256) << 20;
+
+}  // namespace
+
+RenderEngine::RenderEngine(const ComputeOptions& options)
+    : options_(options) {}
+
+RenderEngine::~RenderEngine() = default;
+
+void RenderEngine::prepare(const ParameterGrid& grid) {
+  if (grid.alpha_num_intervals < 1 || grid.beta_num_intervals < 1 ||
+      grid.num_iterations < 1 ||
+      grid.num_seedpoints < static_cast<int>(grid.seedpoints.size())) {
+    throw std::invalid_argument("invalid parameter grid");
+  }
+  alphas_ = parameter_values(grid.alphamin, grid.alphamax,
+                             grid.alpha_num_intervals);
+  betas_ =
+      parameter_values(grid.betamin, grid.betamax, grid.beta_num_intervals);
+  make_seed_points(grid.num_seedpoints, grid.seedpoints, seed_x_, seed_y_);
+}
+
+GridStats RenderEngine::render(const ParameterGrid& grid, float* result,
+                               Checkpoint* checkpoint,
+                               OrbitState* orbit_state,
+                               Instrumentation* instrumentation) {
+  prepare(grid);
+  stats_ = compute_grid(result, alphas_, betas_, seed_x_, seed_y_,
+                        grid.num_iterations, grid.threshold, options_,
+                        checkpoint, orbit_state, instrumentation, &workspace_);
+  return stats_;
+}
+
+const aligned_vector<float>& RenderEngine::render(const ParameterGrid& grid) {
+  // keeps its capacity, so previews of the same size do not allocate
+  result_.resize(grid.num_pixels());
+  render(grid, result_.data());
+  return result_;
+}
+
+GridStats RenderEngine::render(const ParameterGrid& grid,
+                               const std::vector<RenderSink*>& sinks) {
+  render(grid);
+  if (stats_.cancelled) return stats_;
+  RenderResult result{grid,    options_, alphas_, betas_,
+                      seed_x_, seed_y_,  result_.data()};
+  for (RenderSink* sink : sinks) sink->consume(result);
+  return stats_;
+}
+
+GridStats RenderEngine::render(const ParameterGrid& grid,
+                               MappedRawResult& result) {
+  prepare(grid);
+  int alpha_num_params = grid.width();
+  int beta_num_params = grid.height();
+  std::size_t row_bytes = alpha_num_params * sizeof(float);
+  int band_rows = std::max<std::size_t>(1, BAND_BYTES / row_bytes /
+                                               options_.tile_size) *
+                  options_.tile_size;
+
+  GridStats stats;
+  aligned_vector<float> band_betas;
+  for (int r0 = 0; r0 < beta_num_params; r0 += band_rows) {
+    int rows = std::min(band_rows, beta_num_params - r0);
+    // row r of the grid has beta betas[beta_num_params - 1 - r]
+    band_betas.assign(betas_.begin() + (beta_num_params - r0 - rows),
+                      betas_.begin() + (beta_num_params - r0));
+    std::size_t first_pixel = static_cast<std::size_t>(r0) * alpha_num_params;
+    GridStats band = compute_grid(result.data() + first_pixel, alphas_,
+                                  band_betas, seed_x_, seed_y_,
+                                  grid.num_iterations, grid.threshold,
+                                  options_, nullptr, nullptr, nullptr,
+                                  &workspace_);
+    result.release(first_pixel,
+                   static_cast<std::size_t>(rows) * alpha_num_params);
+
+    stats.threads.resize(std::max(stats.threads.size(), band.threads.size()));
+    for (std::size_t t = 0; t < band.threads.size(); t++) {
+      stats.threads[t].busy_seconds += band.threads[t].busy_seconds;
+      stats.threads[t].idle_seconds += band.threads[t].idle_seconds;
+      stats.threads[t].tiles += band.threads[t].tiles;
+      stats.threads[t].stolen += band.threads[t].stolen;
+    }
+    stats.filled_pixels += band.filled_pixels;
+    stats.periodic_pixels += band.periodic_pixels;
+    stats.periodic_seeds += band.periodic_seeds;
+    if (band.cancelled) {
+      stats.cancelled = true;
+      break;
+    }
+  }
+  stats_ = stats;
+  return stats_;
+}
+
+GridStats RenderEngine::deepen(const ParameterGrid& grid, float* result,
+                               const OrbitState& previous,
+                               OrbitState* orbit_state) {
+  prepare(grid);
+  stats_ = deepen_grid(result, alphas_, betas_, previous, grid.num_iterations,
+                       grid.threshold, options_, orbit_state, &workspace_);
+  return stats_;
+}
+
+GridStats RenderEngine::stream(const ParameterGrid& grid,
+                               const std::function<void(const float*)>& sink) {
+  prepare(grid);
+  stats_ = stream_grid(alphas_, betas_, seed_x_, seed_y_, grid.num_iterations,
+                       grid.threshold, options_, sink, &workspace_);
+  return stats_;
+}
@@ -0,0 +1,158 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compute.hpp"
+#include "picture.hpp"
+#include "textexport.hpp"
+
+class MappedRawResult;
+
+// the parameter plane of a render and its seed points (see
+// make_seed_points)
+struct ParameterGrid : GridParameters {
+  int num_seedpoints = 8;
+  std::vector<float> seedpoints;
+
+  int width() const { return alpha_num_intervals + 1; }
+  int height() const { return beta_num_intervals + 1; }
+  std::size_t num_pixels() const {
+    return static_cast<std::size_t>(width()) * height();
+  }
+};
+
+// a computed grid as passed to the sinks, values has grid.height() rows of
+// grid.width() pixels from the largest beta to the smallest
+struct RenderResult {
+  const ParameterGrid& grid;
+  const ComputeOptions& options;
+  const aligned_vector<float>& alphas;
+  const aligned_vector<float>& betas;
+  const aligned_vector<float>& seed_x;
+  const aligned_vector<float>& seed_y;
+  const float* values;
+
+  // describe_parameters() of the render
+  std::string parameters() const;
+};
+
+// receives the results of a RenderEngine, may throw
+class RenderSink {
+ public:
+  virtual ~RenderSink() = default;
+  virtual void consume(const RenderResult& result) = 0;
+};
+
+// the image files of options (colored PNG, 16 bit gray PNG, PFM) written in
+// one pass over the rows, the PNGs compress batches of rows in parallel (see
+// PngOptions::num_threads). Rows of a mapped result are dropped from memory
+// once they are written.
+class ImageSink : public RenderSink {
+ public:
+  explicit ImageSink(MappedRawResult* mapped = nullptr) : mapped_(mapped) {}
+  void consume(const RenderResult& result) override;
+
+ private:
+  MappedRawResult* mapped_;
+};
+
+// binary result file, see rawresult.hpp
+class RawSink : public RenderSink {
+ public:
+  explicit RawSink(const std::string& filename) : filename_(filename) {}
+  void consume(const RenderResult& result) override;
+
+ private:
+  std::string filename_;
+};
+
+// text table, see textexport.hpp
+class CsvSink : public RenderSink {
+ public:
+  CsvSink(const std::string& filename, const TextFormat& format)
+      : filename_(filename), format_(format) {}
+  void consume(const RenderResult& result) override;
+  std::size_t bytes() const { return bytes_; }  // of the last result
+
+ private:
+  std::string filename_;
+  TextFormat format_;
+  std::size_t bytes_ = 0;
+};
+
+// computes grids with the same options into memory. Reusing one engine for
+// many renders, e.g. repeated small previews, keeps its threads, scratch
+// memory and result buffer alive, so only the first render pays for them.
+class RenderEngine {
+ public:
+  explicit RenderEngine(const ComputeOptions& options = ComputeOptions());
+  ~RenderEngine();
+
+  // may be changed between renders
+  ComputeOptions& options() { return options_; }
+
+  // flag another thread sets to stop a render early, which then returns
+  // stats with cancelled set and does not call the sinks. The engine never
+  // resets it.
+  void set_cancel(const std::atomic<bool>* cancel) {
+    workspace_.cancel = cancel;
+  }
+
+  // computes the grid into result, which holds grid.num_pixels() floats,
+  // see compute_grid for the optional arguments
+  GridStats render(const ParameterGrid& grid, float* result,
+                   Checkpoint* checkpoint = nullptr,
+                   OrbitState* orbit_state = nullptr,
+                   Instrumentation* instrumentation = nullptr);
+  // computes the grid into the buffer of the engine, which stays valid
+  // until the next render
+  const aligned_vector<float>& render(const ParameterGrid& grid);
+  // computes the grid into the buffer of the engine and passes it to the
+  // sinks in order, unless cancelled
+  GridStats render(const ParameterGrid& grid,
+                   const std::vector<RenderSink*>& sinks);
+  // computes the grid into a mapped result file in bands of whole tile
+  // rows, each band is dropped from memory once it is done, so that grids
+  // larger than the memory fit
+  GridStats render(const ParameterGrid& grid, MappedRawResult& result);
+  // continues the bounded pixels of previous, see deepen_grid
+  GridStats deepen(const ParameterGrid& grid, float* result,
+                   const OrbitState& previous,
+                   OrbitState* orbit_state = nullptr);
+  // computes the rows in order and passes them to sink without keeping the
+  // result, see stream_grid
+  GridStats stream(const ParameterGrid& grid,
+                   const std::function<void(const float*)>& sink);
+
+  // sets up the alphas, betas and seeds of grid, done by every render
+  void prepare(const ParameterGrid& grid);
+
+  // alphas, betas and seeds of the last render or prepare
+  const aligned_vector<float>& alphas() const { return alphas_; }
+  const aligned_vector<float>& betas() const { return betas_; }
+  const aligned_vector<float>& seed_x() const { return seed_x_; }
+  const aligned_vector<float>& seed_y() const { return seed_y_; }
+  const GridStats& stats() const { return stats_; }
+
+ private:
+  ComputeOptions options_;
+  GridWorkspace workspace_;
+  aligned_vector<float> alphas_;
+  aligned_vector<float> betas_;
+  aligned_vector<float> seed_x_;
+  aligned_vector<float> seed_y_;
+  aligned_vector<float> result_;
+  GridStats stats_;
+};
+
+// opens the image files selected in options
+std::vector<std::unique_ptr<RowWriter>> open_images(
+    float threshold, int width, int height, const ComputeOptions& options);
+
+#endif  // RENDER_H
@@ -0,0 +1,119 @@
+#include "scaling.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <stdexcept>
+
+namespace {
+
+// 1, 2, 4, ... below max_threads and max_threads
+std::vector<int> thread_counts(int max_threads) {
+  std::vector<int> counts;
+  for (int t = 1; t < max_threads; t *= 2) counts.push_back(t);
+  counts.push_back(max_threads);
+  return counts;
+}
+
+}  // namespace
+
+std::vector<ScalingPoint> scaling_study(
+    const GridParameters& grid, const aligned_vector<float>& seed_x,
+    const aligned_vector<float>& seed_y, const ComputeOptions& options,
+    const std::vector<int>& sizes, int max_threads, int repetitions) {
+  std::vector<ScalingPoint> points;
+  for (int width : sizes) {
+    int height = std::max(
+        1, static_cast<int>(static_cast<long long>(width) *
+                            (grid.beta_num_intervals + 1) /
+                            (grid.alpha_num_intervals + 1)));
+    aligned_vector<float> alphas =
+        parameter_values(grid.alphamin, grid.alphamax, width - 1);
+    aligned_vector<float> betas =
+        parameter_values(grid.betamin, grid.betamax, height - 1);
+    aligned_vector<float> result(static_cast<std::size_t>(width) * height);
+
+    double serial_seconds = 0;
+    for (int threads : thread_counts(max_threads)) {
+      ComputeOptions run_options = options;
+      run_options.schedule = Schedule::tiles;  // the one with thread stats
+      run_options.num_threads = threads;
+
+      std::vector<double> seconds;
+      std::vector<GridStats> stats;
+      for (int r = 0; r < repetitions; r++) {
+        auto start = std::chrono::steady_clock::now();
+        stats.push_back(compute_grid(result.data(), alphas, betas, seed_x,
+                                     seed_y, grid.num_iterations,
+                                     grid.threshold, run_options));
+        seconds.push_back(std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+      }
+      // the thread stats of the median run
+      std::vector<int> order(repetitions);
+      for (int r = 0; r < repetitions; r++) order[r] = r;
+      std::sort(order.begin(), order.end(),
+                [&](int a, int b) { return seconds[a] < seconds[b]; });
+      int median = order[repetitions / 2];
+
+      ScalingPoint point;
+      point.width = width;
+      point.height = height;
+      point.threads = threads;
+      point.seconds = seconds[median];
+      if (threads == 1) serial_seconds = point.seconds;
+      point.speedup = serial_seconds / point.seconds;
+      point.efficiency = point.speedup / threads;
+      double max_busy = 0, sum_busy = 0, max_idle = 0;
+      for (const ThreadStats& thread : stats[median].threads) {
+        max_busy = std::max(max_busy, thread.busy_seconds);
+        sum_busy += thread.busy_seconds;
+        max_idle = std::max(max_idle, thread.idle_seconds);
+      }
+      point.imbalance = sum_busy > 0 ? max_busy * threads / sum_busy : 1;
+      point.tail_seconds = max_idle;
+      points.push_back(point);
+
+      std::cout << width << "x" << height << ", " << threads
+                << " threads: " << point.seconds << " s, speedup "
+                << point.speedup << ", efficiency " << point.efficiency
+                << ", imbalance " << point.imbalance << ", tail "
+                << point.tail_seconds << " s" << std::endl;
+    }
+  }
+  return points;
+}
+
+void write_scaling(const std::string& prefix,
+                   const std::vector<ScalingPoint>& points) {
+  std::ofstream csv(prefix + ".csv");
+  csv.imbue(std::locale::classic());
+  csv << "width,height,threads,seconds,speedup,efficiency,imbalance,"
+         "tail_seconds\n";
+  for (const ScalingPoint& p : points) {
+    csv << p.width << ',' << p.height << ',' << p.threads << ',' << p.seconds
+        << ',' << p.speedup << ',' << p.efficiency << ',' << p.imbalance
+        << ',' << p.tail_seconds << '\n';
+  }
+  if (!csv.flush()) throw std::runtime_error("error writing " + prefix + ".csv");
+
+  std::ofstream json(prefix + ".json");
+  json.imbue(std::locale::classic());
+  json << "[";
+  for (std::size_t i = 0; i < points.size(); i++) {
+    const ScalingPoint& p = points[i];
+    json << (i > 0 ? ",\n " : "\n ") << "{\"width\": " << p.width
+         << ", \"height\": " << p.height << ", \"threads\": " << p.threads
+         << ", \"seconds\": " << p.seconds << ", \"speedup\": " << p.speedup
+         << ", \"efficiency\": " << p.efficiency
+         << ", \"imbalance\": " << p.imbalance
+         << ", \"tail_seconds\": " << p.tail_seconds << "}";
+  }
+  json << "\n]\n";
+  if (!json.flush()) {
+    throw std::runtime_error("error writing " + prefix + ".json");
+  }
+}
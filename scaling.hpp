@@ -0,0 +1,35 @@
+#ifndef SCALING_H
+#define SCALING_H
+
+#include <string>
+#include <vector>
+
+#include "compute.hpp"
+
+// one run of a thread scaling study
+struct ScalingPoint {
+  int width;
+  int height;
+  int threads;
+  double seconds;     // median wall time of the computation
+  double speedup;     // seconds with one thread / seconds
+  double efficiency;  // speedup / threads
+  double imbalance;   // busy time of the busiest thread / mean busy time
+  double tail_seconds;  // time the first thread to run out of tiles waited
+};
+
+// Strong scaling of compute_grid with the tile schedule: every grid size is
+// computed with 1, 2, 4, ... threads up to max_threads (and max_threads
+// itself), repetitions times each. sizes are grid widths, the heights keep
+// the aspect ratio of the parameter grid. Progress is printed to std::cout.
+std::vector<ScalingPoint> scaling_study(
+    const GridParameters& grid, const aligned_vector<float>& seed_x,
+    const aligned_vector<float>& seed_y, const ComputeOptions& options,
+    const std::vector<int>& sizes, int max_threads, int repetitions);
+
+// write the points as <prefix>.csv and <prefix>.json, throws
+// std::runtime_error on errors
+void write_scaling(const std::string& prefix,
+                   const std::vector<ScalingPoint>& points);
+
+#endif  // SCALING_H
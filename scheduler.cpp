@@ -0,0 +1,188 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// deque of tile indices, owner pops from the front, thieves from the back
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<int> tiles;
+
+  bool pop_front(int& tile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tiles.empty()) return false;
+    tile = tiles.front();
+    tiles.pop_front();
+    return true;
+  }
+
+  bool pop_back(int& tile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tiles.empty()) return false;
+    tile = tiles.back();
+    tiles.pop_back();
+    return true;
+  }
+
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tiles.size();
+  }
+};
+
+// steals a tile from the back of the fullest queue other than self
+bool steal(std::vector<WorkQueue>& queues, int self, int& tile) {
+  while (true) {
+    int victim = -1;
+    std::size_t victim_size = 0;
+    int num_queues = queues.size();
+    for (int q = 0; q < num_queues; q++) {
+      if (q == self) continue;
+      std::size_t size = queues[q].size();
+      if (size > victim_size) {
+        victim = q;
+        victim_size = size;
+      }
+    }
+    if (victim < 0) return false;
+    // the victim may have been emptied in the meantime, then look again
+    if (queues[victim].pop_back(tile)) return true;
+  }
+}
+
+}  // namespace
+
+int default_num_threads() {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return std::max(1u, std::thread::hardware_concurrency());
+#endif
+}
+
+std::vector<Tile> make_tiles(int width, int height, int tile_size) {
+  std::vector<Tile> tiles;
+  for (int y0 = 0; y0 < height; y0 += tile_size) {
+    for (int x0 = 0; x0 < width; x0 += tile_size) {
+      tiles.push_back({x0, y0, std::min(tile_size, width - x0),
+                       std::min(tile_size, height - y0)});
+    }
+  }
+  return tiles;
+}
+
+std::vector<ThreadStats> run_tiles(
+    const std::vector<Tile>& tiles, int num_threads,
+    const std::function<void(const Tile&, int)>& work) {
+  TilePool pool(num_threads);
+  return pool.run(tiles, work);
+}
+
+struct TilePool::State {
+  int num_threads;
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable wake;     // a run started or the pool stops
+  std::condition_variable done;     // a thread finished its part of a run
+  const std::function<void(int)>* job = nullptr;
+  long long generation = 0;         // number of runs started
+  int running = 0;                  // pool threads still in the current run
+  bool stop = false;
+
+  void loop(int thread) {
+    long long seen = 0;
+    while (true) {
+      const std::function<void(int)>* current;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return stop || generation != seen; });
+        if (stop) return;
+        seen = generation;
+        current = job;
+      }
+      (*current)(thread);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--running == 0) done.notify_one();
+    }
+  }
+};
+
+TilePool::TilePool(int num_threads) : state_(new State) {
+  state_->num_threads = std::max(1, num_threads);
+  for (int t = 1; t < state_->num_threads; t++) {
+    state_->threads.emplace_back(&State::loop, state_.get(), t);
+  }
+}
+
+TilePool::~TilePool() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->stop = true;
+  }
+  state_->wake.notify_all();
+  for (std::thread& thread : state_->threads) thread.join();
+}
+
+int TilePool::num_threads() const { return state_->num_threads; }
+
+std::vector<ThreadStats> TilePool::run(
+    const std::vector<Tile>& tiles,
+    const std::function<void(const Tile&, int)>& work) {
+  int num_threads = state_->num_threads;
+  std::vector<WorkQueue> queues(num_threads);
+  int num_tiles = tiles.size();
+  for (int i = 0; i < num_tiles; i++) {
+    queues[i % num_threads].tiles.push_back(i);
+  }
+
+  std::vector<ThreadStats> stats(num_threads);
+  auto time_start = std::chrono::steady_clock::now();
+
+  std::function<void(int)> worker = [&](int thread) {
+    ThreadStats& own = stats[thread];
+    int tile;
+    while (true) {
+      if (!queues[thread].pop_front(tile)) {
+        if (!steal(queues, thread, tile)) break;
+        own.stolen++;
+      }
+      auto tile_start = std::chrono::steady_clock::now();
+      work(tiles[tile], thread);
+      own.busy_seconds += std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - tile_start)
+                              .count();
+      own.tiles++;
+    }
+  };
+
+  if (num_threads > 1) {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    state_->job = &worker;
+    state_->running = num_threads - 1;
+    state_->generation++;
+  }
+  state_->wake.notify_all();
+  worker(0);
+  if (num_threads > 1) {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    state_->done.wait(lock, [&] { return state_->running == 0; });
+  }
+
+  double elapsed_seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - time_start)
+                               .count();
+  for (ThreadStats& s : stats) {
+    s.idle_seconds = std::max(0.0, elapsed_seconds - s.busy_seconds);
+  }
+  return stats;
+}
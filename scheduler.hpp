@@ -0,0 +1,63 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// rectangular block of pixels of the result image
+struct Tile {
+  int x0;
+  int y0;
+  int width;
+  int height;
+};
+
+// what a worker thread did during run_tiles
+struct ThreadStats {
+  double busy_seconds = 0.0;  // time spent inside work()
+  double idle_seconds = 0.0;  // wall time of the run minus busy time
+  int tiles = 0;              // tiles processed
+  int stolen = 0;             // tiles taken from other threads
+};
+
+// number of threads used by default: OMP_NUM_THREADS resp. the OpenMP
+// default if built with OpenMP, the hardware concurrency otherwise
+int default_num_threads();
+
+// splits a width x height image into square tiles with edge length
+// tile_size, the tiles at the right and bottom border may be smaller
+std::vector<Tile> make_tiles(int width, int height, int tile_size);
+
+// calls work(tile, thread) for every tile on num_threads std::threads. The
+// tiles are dealt round robin in the given order to per thread deques, so
+// that every thread starts with the front of the list. A thread whose deque
+// runs empty steals from the back of the fullest other deque. Works without
+// OpenMP.
+std::vector<ThreadStats> run_tiles(
+    const std::vector<Tile>& tiles, int num_threads,
+    const std::function<void(const Tile&, int)>& work);
+
+// the worker threads of run_tiles kept alive between runs, so that many
+// small runs do not pay for starting threads. The calling thread is thread
+// 0, the pool owns the other num_threads - 1. One run at a time.
+class TilePool {
+ public:
+  explicit TilePool(int num_threads);
+  ~TilePool();
+  TilePool(const TilePool&) = delete;
+  TilePool& operator=(const TilePool&) = delete;
+
+  int num_threads() const;
+
+  // same as run_tiles on the threads of the pool
+  std::vector<ThreadStats> run(
+      const std::vector<Tile>& tiles,
+      const std::function<void(const Tile&, int)>& work);
+
+ private:
+  struct State;
+  std::unique_ptr<State> state_;
+};
+
+#endif  // SCHEDULER_H
@@ -0,0 +1,117 @@
+#include "textexport.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// rows formatted per block, a block of a 12000 pixel wide grid is ~6 MB
+constexpr int ROWS_PER_BLOCK = 16;
+
+// longest float: sign, 9 digits, point, exponent "e-45"
+constexpr int MAX_FLOAT_CHARS = 24;
+
+char* format_float(char* first, float value, const TextFormat& format) {
+  std::to_chars_result converted =
+      format.precision > 0
+          ? std::to_chars(first, first + MAX_FLOAT_CHARS, value,
+                          std::chars_format::general, format.precision)
+          : std::to_chars(first, first + MAX_FLOAT_CHARS, value);
+  return converted.ptr;
+}
+
+// formatted values with offsets, text i is text[offsets[i], offsets[i+1])
+struct FormattedValues {
+  std::vector<char> text;
+  std::vector<std::size_t> offsets;
+
+  FormattedValues(const float* values, int size, const TextFormat& format) {
+    text.resize(static_cast<std::size_t>(size) * MAX_FLOAT_CHARS);
+    offsets.resize(size + 1);
+    char* end = text.data();
+    for (int i = 0; i < size; i++) {
+      offsets[i] = end - text.data();
+      end = format_float(end, values[i], format);
+    }
+    offsets[size] = end - text.data();
+  }
+
+  char* copy(int i, char* out) const {
+    std::size_t length = offsets[i + 1] - offsets[i];
+    std::copy(text.data() + offsets[i], text.data() + offsets[i] + length,
+              out);
+    return out + length;
+  }
+};
+
+}  // namespace
+
+std::size_t write_csv(const std::string& filename, const float* result,
+                      const float* alphas, int alpha_num_params,
+                      const float* betas, int beta_num_params,
+                      const TextFormat& format) {
+  std::FILE* file = std::fopen(filename.c_str(), "wb");
+  if (!file) throw std::runtime_error("error opening file " + filename);
+
+  // alpha and beta are the same for many lines, so format them only once
+  FormattedValues alpha_text(alphas, alpha_num_params, format);
+  FormattedValues beta_text(betas, beta_num_params, format);
+
+  const char sep = format.separator;
+  std::string header = std::string("alpha") + sep + "beta" + sep + "value\n";
+  bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+  std::size_t bytes = header.size();
+
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  int num_blocks = (beta_num_params + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+  std::size_t max_line = 3 * MAX_FLOAT_CHARS + 3;
+  std::vector<std::vector<char>> buffers(num_threads);
+  std::vector<std::size_t> lengths(num_threads);
+
+  // a round formats one block per thread, then writes them in order
+  for (int first_block = 0; ok && first_block < num_blocks;
+       first_block += num_threads) {
+    int round_blocks = std::min(num_threads, num_blocks - first_block);
+#pragma omp parallel for schedule(static, 1)
+    for (int i = 0; i < round_blocks; i++) {
+      int first_row = (first_block + i) * ROWS_PER_BLOCK;
+      int last_row = std::min(first_row + ROWS_PER_BLOCK, beta_num_params);
+      std::vector<char>& buffer = buffers[i];
+      buffer.resize(static_cast<std::size_t>(last_row - first_row) *
+                    alpha_num_params * max_line);
+      char* out = buffer.data();
+      for (int r = first_row; r < last_row; r++) {
+        int b = beta_num_params - 1 - r;
+        const float* row = result + static_cast<std::size_t>(r) *
+                                        alpha_num_params;
+        for (int a = 0; a < alpha_num_params; a++) {
+          out = alpha_text.copy(a, out);
+          *out++ = sep;
+          out = beta_text.copy(b, out);
+          *out++ = sep;
+          out = format_float(out, row[a], format);
+          *out++ = '\n';
+        }
+      }
+      lengths[i] = out - buffer.data();
+    }
+    for (int i = 0; ok && i < round_blocks; i++) {
+      ok = std::fwrite(buffers[i].data(), 1, lengths[i], file) == lengths[i];
+      bytes += lengths[i];
+    }
+  }
+
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) throw std::runtime_error("error writing " + filename);
+  return bytes;
+}
@@ -0,0 +1,23 @@
+#ifndef TEXTEXPORT_H
+#define TEXTEXPORT_H
+
+#include <cstddef>
+#include <string>
+
+// layout of the text export
+struct TextFormat {
+  char separator = ' ';  // '\t' for TSV
+  int precision = 0;     // significant digits, 0: shortest exact round trip
+};
+
+// Writes a header line and one "alpha beta value" line per pixel of result
+// (rows from the largest beta to the smallest). Independent of the locale.
+// Blocks of rows are formatted in parallel into per block buffers and
+// written in order. Returns the number of bytes written, throws
+// std::runtime_error on errors.
+std::size_t write_csv(const std::string& filename, const float* result,
+                      const float* alphas, int alpha_num_params,
+                      const float* betas, int beta_num_params,
+                      const TextFormat& format = TextFormat());
+
+#endif  // TEXTEXPORT_H
@@ -0,0 +1,182 @@
+#include "tilecache.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+PlaneView PlaneView::coarser(int factor) const {
+  PlaneView view;
+  view.alpha_spacing = alpha_spacing * factor;
+  view.beta_spacing = beta_spacing * factor;
+  view.x0 = floor_div(x0, factor);
+  view.y0 = floor_div(y0, factor);
+  view.width = static_cast<int>(floor_div(x0 + width - 1, factor) - view.x0 + 1);
+  view.height =
+      static_cast<int>(view.y0 - floor_div(y0 - height + 1, factor) + 1);
+  return view;
+}
+
+PlaneView PlaneView::zoomed(int levels, int x, int y) const {
+  PlaneView view = *this;
+  long long column = x0 + x;
+  long long row = y0 - y;
+  if (levels >= 0) {
+    long long factor = 1LL << levels;
+    view.alpha_spacing = alpha_spacing / factor;
+    view.beta_spacing = beta_spacing / factor;
+    column *= factor;
+    row *= factor;
+  } else {
+    long long factor = 1LL << -levels;
+    view.alpha_spacing = alpha_spacing * factor;
+    view.beta_spacing = beta_spacing * factor;
+    column = floor_div(column, factor);
+    row = floor_div(row, factor);
+  }
+  view.x0 = column - x;
+  view.y0 = row + y;
+  return view;
+}
+
+bool PlaneTileKey::operator<(const PlaneTileKey& other) const {
+  return std::tie(alpha_spacing, beta_spacing, tx, ty, settings) <
+         std::tie(other.alpha_spacing, other.beta_spacing, other.tx, other.ty,
+                  other.settings);
+}
+
+TileCache::Values TileCache::find(const PlaneTileKey& key) {
+  auto found = index_.find(key);
+  if (found == index_.end()) return nullptr;
+  tiles_.splice(tiles_.begin(), tiles_, found->second);
+  return found->second->second;
+}
+
+void TileCache::insert(const PlaneTileKey& key, Values values) {
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    bytes_ -= found->second->second->size() * sizeof(float);
+    tiles_.erase(found->second);
+    index_.erase(found);
+  }
+  bytes_ += values->size() * sizeof(float);
+  tiles_.emplace_front(key, std::move(values));
+  index_[key] = tiles_.begin();
+  // the new tile itself is kept even if it alone exceeds the budget
+  while (bytes_ > budget_ && tiles_.size() > 1) {
+    const Entry& oldest = tiles_.back();
+    bytes_ -= oldest.second->size() * sizeof(float);
+    index_.erase(oldest.first);
+    tiles_.pop_back();
+  }
+}
+
+std::string PlaneRenderer::settings(int num_iterations, float threshold,
+                                    const aligned_vector<float>& seed_x,
+                                    const aligned_vector<float>& seed_y) const {
+  return describe_parameters(num_iterations, threshold, 0, 0, 0, 0, 0, 0,
+                             seed_x, seed_y, options_);
+}
+
+TileCache::Values PlaneRenderer::assemble(const PlaneTileKey& key) {
+  const int T = PLANE_TILE_SIZE;
+  // pixel i of the tile is pixel 2 i of the lattice with half the spacing,
+  // which lies in the finer tile 2 tx + 2 i / T
+  TileCache::Values finer[2][2];
+  for (int dy = 0; dy < 2; dy++) {
+    for (int dx = 0; dx < 2; dx++) {
+      PlaneTileKey finer_key = key;
+      finer_key.alpha_spacing = key.alpha_spacing / 2;
+      finer_key.beta_spacing = key.beta_spacing / 2;
+      finer_key.tx = 2 * key.tx + dx;
+      finer_key.ty = 2 * key.ty + dy;
+      finer[dy][dx] = cache_.find(finer_key);
+      if (!finer[dy][dx]) return nullptr;
+    }
+  }
+  auto values = std::make_shared<aligned_vector<float>>(T * T);
+  for (int j = 0; j < T; j++) {
+    // rows are stored from the largest beta
+    const float* finer_row =
+        finer[2 * j / T][0]->data() + (T - 1 - 2 * j % T) * T;
+    const float* finer_row_right =
+        finer[2 * j / T][1]->data() + (T - 1 - 2 * j % T) * T;
+    float* row = values->data() + (T - 1 - j) * T;
+    for (int i = 0; i < T / 2; i++) row[i] = finer_row[2 * i];
+    for (int i = T / 2; i < T; i++) {
+      row[i] = finer_row_right[2 * i - T];
+    }
+  }
+  return values;
+}
+
+PlaneStats PlaneRenderer::render(const PlaneView& view, int num_iterations,
+                                 float threshold,
+                                 const aligned_vector<float>& seed_x,
+                                 const aligned_vector<float>& seed_y,
+                                 float* result) {
+  const int T = PLANE_TILE_SIZE;
+  PlaneStats stats;
+  PlaneTileKey key;
+  key.settings = settings(num_iterations, threshold, seed_x, seed_y);
+  key.alpha_spacing = view.alpha_spacing;
+  key.beta_spacing = view.beta_spacing;
+
+  // small subtiles, so that the threads share every tile
+  ComputeOptions tile_options = options_;
+  tile_options.schedule = Schedule::tiles;
+  tile_options.tile_size = 16;
+  aligned_vector<float> alphas(T), betas(T);
+
+  long long last_row = view.y0 - view.height + 1;  // smallest beta
+  for (long long ty = floor_div(view.y0, T); ty >= floor_div(last_row, T);
+       ty--) {
+    for (long long tx = floor_div(view.x0, T);
+         tx <= floor_div(view.x0 + view.width - 1, T); tx++) {
+      if (workspace_.cancel && workspace_.cancel->load()) {
+        stats.cancelled = true;
+        return stats;
+      }
+      key.tx = tx;
+      key.ty = ty;
+      TileCache::Values values = cache_.find(key);
+      if (values) {
+        stats.cached_tiles++;
+      } else if ((values = assemble(key))) {
+        cache_.insert(key, values);
+        stats.assembled_tiles++;
+      } else {
+        for (int i = 0; i < T; i++) {
+          alphas[i] = static_cast<float>((tx * T + i) * view.alpha_spacing);
+          betas[i] = static_cast<float>((ty * T + i) * view.beta_spacing);
+        }
+        auto computed = std::make_shared<aligned_vector<float>>(T * T);
+        GridStats grid_stats =
+            compute_grid(computed->data(), alphas, betas, seed_x, seed_y,
+                         num_iterations, threshold, tile_options, nullptr,
+                         nullptr, nullptr, &workspace_);
+        if (grid_stats.cancelled) {
+          stats.cancelled = true;
+          return stats;
+        }
+        values = computed;
+        cache_.insert(key, values);
+        stats.computed_tiles++;
+      }
+
+      // copy the part of the tile inside the view
+      long long row_begin = std::max(ty * T, last_row);
+      long long row_end = std::min(ty * T + T - 1, view.y0);
+      long long column_begin = std::max(tx * T, view.x0);
+      long long column_end = std::min(tx * T + T - 1,
+                                      view.x0 + view.width - 1);
+      for (long long row = row_begin; row <= row_end; row++) {
+        const float* tile_row =
+            values->data() + (T - 1 - (row - ty * T)) * T;
+        std::copy(tile_row + (column_begin - tx * T),
+                  tile_row + (column_end - tx * T) + 1,
+                  result + (view.y0 - row) * view.width +
+                      (column_begin - view.x0));
+      }
+    }
+  }
+  return stats;
+}
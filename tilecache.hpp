@@ -0,0 +1,126 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "compute.hpp"
+
+// Views of the parameter plane are put together from square tiles of a
+// fixed lattice, so that panning only computes the tiles coming into view
+// and zooming out reuses the finer tiles computed before.
+
+// edge length of the tiles in pixels, even
+constexpr int PLANE_TILE_SIZE = 64;
+
+// floor(a / b) for b > 0
+inline long long floor_div(long long a, long long b) {
+  return a / b - (a % b < 0);
+}
+
+// width x height pixels of the lattice with the given spacings: pixel (x, y)
+// has alpha = (x0 + x) * alpha_spacing and beta = (y0 - y) * beta_spacing, so
+// the top row has the largest beta like the rows of compute_grid
+struct PlaneView {
+  double alpha_spacing = 0;
+  double beta_spacing = 0;
+  long long x0 = 0;
+  long long y0 = 0;
+  int width = 0;
+  int height = 0;
+
+  // the same area at 1 / factor of the resolution, factor a power of two:
+  // pixel (x, y) of this view lies in pixel (floor((x0 + x) / factor) - x0',
+  // y0' - floor((y0 - y) / factor)) of the coarser one
+  PlaneView coarser(int factor) const;
+  // the view zoomed in (levels > 0) or out by a factor of 2 per level, the
+  // pixel (x, y) stays at the same parameters
+  PlaneView zoomed(int levels, int x, int y) const;
+};
+
+// one tile of the lattice: the pixels tx * PLANE_TILE_SIZE + i, ty *
+// PLANE_TILE_SIZE + j for i, j < PLANE_TILE_SIZE, rows from the largest beta
+struct PlaneTileKey {
+  std::string settings;  // see PlaneRenderer::settings
+  double alpha_spacing;
+  double beta_spacing;
+  long long tx;
+  long long ty;
+
+  bool operator<(const PlaneTileKey& other) const;
+};
+
+// tiles up to a memory budget, the least recently used one is evicted first
+class TileCache {
+ public:
+  using Values = std::shared_ptr<const aligned_vector<float>>;
+
+  explicit TileCache(std::size_t budget_bytes) : budget_(budget_bytes) {}
+
+  // the tile, now the most recently used one, or nullptr
+  Values find(const PlaneTileKey& key);
+  void insert(const PlaneTileKey& key, Values values);
+
+  std::size_t bytes() const { return bytes_; }
+  std::size_t size() const { return index_.size(); }
+
+ private:
+  using Entry = std::pair<PlaneTileKey, Values>;
+
+  std::size_t budget_;
+  std::size_t bytes_ = 0;
+  std::list<Entry> tiles_;  // most recently used first
+  std::map<PlaneTileKey, std::list<Entry>::iterator> index_;
+};
+
+struct PlaneStats {
+  int cached_tiles = 0;     // found in the cache
+  int assembled_tiles = 0;  // taken from the four cached finer tiles
+  int computed_tiles = 0;
+  bool cancelled = false;   // the result is incomplete
+};
+
+// renders views through a TileCache, the missing tiles are computed with
+// compute_grid on threads and scratches kept alive between renders. The
+// tiles take their parameters from the lattice rather than from a
+// ParameterGrid, so the GUI does not go through a RenderEngine.
+class PlaneRenderer {
+ public:
+  explicit PlaneRenderer(std::size_t budget_bytes) : cache_(budget_bytes) {}
+
+  // may be changed between renders, the settings of the tiles include them
+  ComputeOptions& options() { return options_; }
+
+  // see RenderEngine::set_cancel
+  void set_cancel(const std::atomic<bool>* cancel) {
+    workspace_.cancel = cancel;
+  }
+
+  // describe_parameters() of everything but the grid, the part of the keys
+  // which has to match for a tile to be reused
+  std::string settings(int num_iterations, float threshold,
+                       const aligned_vector<float>& seed_x,
+                       const aligned_vector<float>& seed_y) const;
+
+  // computes view into result, view.height rows of view.width pixels
+  PlaneStats render(const PlaneView& view, int num_iterations,
+                    float threshold, const aligned_vector<float>& seed_x,
+                    const aligned_vector<float>& seed_y, float* result);
+
+  TileCache& cache() { return cache_; }
+
+ private:
+  // values of the tile from the four finer tiles, nullptr unless all of
+  // them are cached
+  TileCache::Values assemble(const PlaneTileKey& key);
+
+  ComputeOptions options_;
+  GridWorkspace workspace_;
+  TileCache cache_;
+};
+
+#endif  // TILECACHE_H